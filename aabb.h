@@ -0,0 +1,61 @@
+#ifndef RT_AABB
+#define RT_AABB
+
+#include "rt.h"
+#include "ray.h"
+
+// axis-aligned bounding box
+struct aabb
+{
+    point3 minimum;
+    point3 maximum;
+
+    aabb() {}
+    aabb(const point3& a, const point3& b) : minimum(a), maximum(b) {}
+
+    point3 min() const { return minimum; }
+    point3 max() const { return maximum; }
+
+    point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+    // slab test: the ray is inside the box where its [t0, t1] intervals for all three axes overlap
+    bool hit(const ray& r, real t_min, real t_max) const
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            real inv_d = 1.0 / r.direction()[a];
+            real t0 = (minimum[a] - r.origin()[a]) * inv_d;
+            real t1 = (maximum[a] - r.origin()[a]) * inv_d;
+            if (inv_d < 0.0)
+                std::swap(t0, t1);
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max <= t_min)
+                return false;
+        }
+        return true;
+    }
+
+    int longest_axis() const
+    {
+        vec3 extent = maximum - minimum;
+        if (extent.x() > extent.y() && extent.x() > extent.z())
+            return 0;
+        return extent.y() > extent.z() ? 1 : 2;
+    }
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1)
+{
+    point3 small(fmin(box0.min().x(), box1.min().x()),
+                 fmin(box0.min().y(), box1.min().y()),
+                 fmin(box0.min().z(), box1.min().z()));
+
+    point3 big(fmax(box0.max().x(), box1.max().x()),
+               fmax(box0.max().y(), box1.max().y()),
+               fmax(box0.max().z(), box1.max().z()));
+
+    return aabb(small, big);
+}
+
+#endif // RT_AABB
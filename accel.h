@@ -0,0 +1,46 @@
+#ifndef RT_ACCEL
+#define RT_ACCEL
+
+#include "bvh.h"
+#include "linear_bvh.h"
+#include "bvh4.h"
+
+// acceleration structures the renderer can trace the scene through, for comparing them on the same scene
+enum class accel_type
+{
+    bvh,        // bvh_node: binary tree of shared_ptr nodes
+    linear_bvh, // linear_bvh: flattened binary tree
+    bvh4,       // bvh4: 4-wide tree with SIMD box tests
+};
+
+inline const char* accel_type_name(accel_type type)
+{
+    switch (type)
+    {
+    case accel_type::bvh:        return "bvh";
+    case accel_type::linear_bvh: return "linear_bvh";
+    default:                     return "bvh4";
+    }
+}
+
+// storage is the leaf storage of the flattened BVHs (e.g. sphere_soa for spheres), bvh_node ignores it
+template <typename primitive, typename storage = primitive_array<primitive>>
+shared_ptr<hittable> build_accel(const vector<primitive>& objects, accel_type type, bvh_split_method method, bvh_build_stats* stats = nullptr)
+{
+    switch (type)
+    {
+    case accel_type::bvh:
+    {
+        hittable_list list;
+        for (const auto& obj : objects)
+            list.add(make_shared<primitive>(obj));
+        return make_shared<bvh_node>(list, method, stats);
+    }
+    case accel_type::linear_bvh:
+        return make_shared<linear_bvh<primitive, storage>>(objects, method, stats);
+    default:
+        return make_shared<bvh4<primitive, storage>>(objects, method, stats);
+    }
+}
+
+#endif // RT_ACCEL
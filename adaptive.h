@@ -0,0 +1,77 @@
+#ifndef RT_ADAPTIVE
+#define RT_ADAPTIVE
+
+#include <cstdint>
+#include <vector>
+
+#include "rt.h"
+#include "vec3.h"
+#include "settings.h"
+
+using std::vector;
+
+// means below this are treated as this, so near-black pixels don't need a near-zero absolute error
+const double ADAPTIVE_MIN_LUMINANCE = 0.05;
+
+inline double luminance(const color& c)
+{
+    return 0.2126 * c.r() + 0.7152 * c.g() + 0.0722 * c.b();
+}
+
+// How converged one pixel is: the running mean and variance of its samples' luminance (Welford's online
+// algorithm). The samples themselves are summed in the renderer's hdr_buffer.
+struct pixel_estimate
+{
+    uint32_t samples = 0;
+    double mean = 0;
+    double m2 = 0; // sum of squared differences from the mean
+
+    void add(const color& sample)
+    {
+        samples++;
+        double l = luminance(sample);
+        double delta = l - mean;
+        mean += delta / samples;
+        m2 += delta * (l - mean);
+    }
+
+    double relative_error() const
+    {
+        if (samples < 2)
+            return INF;
+        double variance = m2 / (samples - 1);
+        return sqrt(variance / samples) / fmax(mean, ADAPTIVE_MIN_LUMINANCE);
+    }
+};
+
+// Splits up to budget samples among the unconverged pixels in proportion to their error. Returns the extra
+// samples for each pixel; all zero once every pixel has converged or hit settings.adaptive_max_samples.
+inline vector<uint32_t> allocate_adaptive_samples(const vector<pixel_estimate>& pixels, uint64_t budget, const render_settings& settings)
+{
+    vector<uint32_t> extra(pixels.size(), 0);
+
+    double total_error = 0;
+    for (const auto& p : pixels)
+    {
+        double error = p.relative_error();
+        if (error > settings.adaptive_max_error && p.samples < settings.adaptive_max_samples)
+            total_error += error;
+    }
+    if (total_error == 0)
+        return extra;
+
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        double error = pixels[i].relative_error();
+        if (error <= settings.adaptive_max_error || pixels[i].samples >= settings.adaptive_max_samples)
+            continue;
+
+        // round up so every unconverged pixel makes progress, even if the budget is overshot slightly
+        double share = std::ceil(budget * (error / total_error));
+        extra[i] = static_cast<uint32_t>(fmin(share, settings.adaptive_max_samples - pixels[i].samples));
+    }
+
+    return extra;
+}
+
+#endif // RT_ADAPTIVE
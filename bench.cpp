@@ -0,0 +1,131 @@
+// Benchmark suite: renders a fixed set of scenes at a fixed seed, resolution and sample count several times
+// each and prints one CSV row per scene to stdout, for comparing builds over time. Progress goes to stderr.
+//
+// Usage: bench [--runs N] [--only SCENE] [any render setting, e.g. --spp 16 --threads 4 --accel linear_bvh]
+
+// rays are counted for Mrays/s; the counters cost about as much as run-to-run noise
+#define RT_STATS
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "rt.h"
+#include "accel.h"
+#include "sphere_soa.h"
+#include "scene.h"
+#include "settings.h"
+#include "renderer.h"
+#include "stats.h"
+
+using std::vector;
+
+struct bench_case
+{
+    std::string scene;
+    uint32_t size;
+};
+
+// the book's final scene at a few sizes, then the glass-heavy and deep-bounce scenes
+const bench_case BENCH_CASES[] = {
+    { "random", 100 },
+    { "random", 484 },
+    { "random", 4096 },
+    { "glass", 64 },
+    { "enclosed", 256 },
+};
+
+double median(vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 == 1 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+uint64_t rays_traced()
+{
+    render_stats s = stats_registry::get().total();
+    return s.primary_rays + s.bounce_rays;
+}
+
+int main(int argc, char** argv)
+{
+    render_settings settings;
+    settings.image_width = 320;
+    settings.samples_per_pixel = 8;
+    settings.progress = false;
+
+    int runs = 5;
+    std::string only;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || i + 1 >= argc)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--runs N] [--only SCENE] [--KEY VALUE]...\n";
+            return 1;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value = argv[++i];
+        bool ok = true;
+        if (key == "runs")
+            ok = parse_count(value, runs) && runs > 0;
+        else if (key == "only")
+            only = value;
+        else
+            ok = apply_setting(settings, key, value);
+
+        if (!ok)
+        {
+            std::cerr << "Bad argument '" << arg << " " << value << "'\n";
+            return 1;
+        }
+    }
+    if (!check_settings(settings))
+        return 1;
+
+    std::cout << "scene,size,spheres,width,height,spp,threads,accel,runs,build_ms,median_s,min_s,max_s,rays,mrays_per_s\n";
+
+    for (const bench_case& c : BENCH_CASES)
+    {
+        if (!only.empty() && c.scene != only)
+            continue;
+
+        scene world;
+        make_scene(c.scene, c.size, world);
+        camera cam = world.view.make_camera(settings.aspect_ratio);
+
+        bvh_build_stats bvh_stats;
+        shared_ptr<hittable> world_accel = build_accel<sphere, sphere_soa>(world.spheres, settings.accel, settings.bvh_split, &bvh_stats);
+
+        vector<double> seconds;
+        uint64_t rays = 0;
+        unsigned threads = 0;
+        for (int run = 0; run < runs; run++)
+        {
+            renderer render(settings, cam, *world_accel);
+            threads = render.pool.size();
+
+            uint64_t rays_before = rays_traced();
+            render_timer timer;
+            render.render();
+            seconds.push_back(timer.wall_seconds());
+            // every run traces the same rays, the seed is fixed
+            rays = rays_traced() - rays_before;
+
+            std::cerr << c.scene << " " << c.size << ": run " << run + 1 << "/" << runs << " " << seconds.back() << " s\n";
+        }
+
+        double median_seconds = median(seconds);
+        std::cout << c.scene << "," << c.size << "," << world.spheres.size() << "," << settings.image_width << ","
+                  << settings.image_height() << "," << settings.samples_per_pixel << "," << threads << ","
+                  << accel_type_name(settings.accel) << "," << runs << "," << bvh_stats.build_seconds * 1000.0 << ","
+                  << median_seconds << "," << *std::min_element(seconds.begin(), seconds.end()) << ","
+                  << *std::max_element(seconds.begin(), seconds.end()) << "," << rays << ","
+                  << rays / median_seconds / 1e6 << std::endl;
+    }
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+# Builds and runs the benchmark suite, appending its CSV to bench.csv. Arguments are passed on to bench,
+# e.g. ./bench.sh --runs 3 --threads 4
+g++ -O2 -march=native -pthread bench.cpp -o bench.exe && ./bench.exe "$@" | tee -a bench.csv
@@ -0,0 +1,442 @@
+#ifndef RT_BVH
+#define RT_BVH
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+
+#include "rt.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+// how a BVH builder chooses where to split a range of objects into two children
+enum class bvh_split_method
+{
+    median, // half the objects on each side, along the axis of greatest centroid spread
+    sah,    // binned surface area heuristic: minimize the expected cost of tracing a ray through the children
+};
+
+inline const char* bvh_split_method_name(bvh_split_method method)
+{
+    return method == bvh_split_method::median ? "median" : "sah";
+}
+
+// relative costs the surface area heuristic trades off: visiting a node (one box test) vs intersecting an object
+const double BVH_TRAVERSAL_COST = 1.0;
+const double BVH_INTERSECT_COST = 1.0;
+const int BVH_SAH_BINS = 16;
+
+// Ranges at least this big are binned in parallel chunks and have their subtrees built on separate threads.
+// Below it the work is too small to be worth a thread.
+const size_t BVH_PARALLEL_THRESHOLD = 16384;
+const unsigned BVH_BUILD_THREADS = 0; // 0 = one per hardware thread
+
+struct bvh_build_stats
+{
+    size_t node_count = 0;
+    size_t object_count = 0;
+    // expected box + object tests for a ray that hits the root box (sum over nodes of cost * area / root area)
+    double sah_cost = 0;
+    double build_seconds = 0;
+};
+
+inline double surface_area(const aabb& box)
+{
+    vec3 d = box.max() - box.min();
+    return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+inline unsigned bvh_build_threads()
+{
+    unsigned threads = BVH_BUILD_THREADS ? BVH_BUILD_THREADS : std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+// how many pieces to process [start, end) in: up to one per thread, each at least BVH_PARALLEL_THRESHOLD long
+inline size_t bvh_chunk_count(size_t start, size_t end)
+{
+    return std::max<size_t>(1, std::min<size_t>(bvh_build_threads(), (end - start) / BVH_PARALLEL_THRESHOLD));
+}
+
+// Threads running build work besides the ones that started a build, over every build in the process. Subtrees
+// and chunked passes nest (a subtree's splits are binned in chunks, its own subtrees spawn more), so each claims
+// its threads from this budget of bvh_build_threads() - 1, and whatever finds none left runs on its own thread.
+inline std::atomic<unsigned> bvh_extra_threads{0};
+
+// claims up to wanted threads from the budget and returns how many it got
+inline unsigned bvh_claim_threads(unsigned wanted)
+{
+    unsigned limit = bvh_build_threads() - 1;
+    unsigned used = bvh_extra_threads.load();
+    unsigned got;
+    do
+    {
+        got = std::min(wanted, used < limit ? limit - used : 0);
+        if (got == 0)
+            return 0;
+    } while (!bvh_extra_threads.compare_exchange_weak(used, used + got));
+    return got;
+}
+
+inline void bvh_release_threads(unsigned count)
+{
+    bvh_extra_threads -= count;
+}
+
+// Calls fn(chunk, chunk_start, chunk_end) for chunk_count equal pieces of [start, end), concurrently on as many
+// threads as the budget allows. The pieces don't depend on the threads, so neither does the result.
+template <typename chunk_fn>
+inline void bvh_for_chunks(size_t start, size_t end, size_t chunk_count, chunk_fn fn)
+{
+    auto chunk_start = [&](size_t c) { return start + (end - start) * c / chunk_count; };
+    unsigned extra = chunk_count > 1 ? bvh_claim_threads(static_cast<unsigned>(chunk_count - 1)) : 0;
+    // thread t takes chunks t, t + thread count, ...
+    auto run = [&](size_t first) {
+        for (size_t c = first; c < chunk_count; c += extra + 1)
+            fn(c, chunk_start(c), chunk_start(c + 1));
+    };
+
+    vector<std::thread> threads;
+    for (unsigned t = 1; t <= extra; t++)
+        threads.emplace_back(run, t);
+    run(0);
+    for (auto& thread : threads)
+        thread.join();
+    bvh_release_threads(extra);
+}
+
+// Starts build(), which builds the subtree over [start, end) and returns its cost, on a thread of its own if the
+// range is worth it and the budget has a thread left. Otherwise the future is invalid and the caller builds it.
+template <typename build_fn>
+inline std::future<double> bvh_spawn_subtree(size_t start, size_t end, build_fn build)
+{
+    if (end - start < BVH_PARALLEL_THRESHOLD || bvh_claim_threads(1) == 0)
+        return std::future<double>();
+
+    return std::async(std::launch::async, [build] {
+        double cost = build();
+        bvh_release_threads(1);
+        return cost;
+    });
+}
+
+// per-object data the builders work on, so each object's bounds are computed once instead of on every comparison
+struct bvh_primitive
+{
+    aabb box;
+    point3 centroid;
+    size_t index; // into the object list the BVH is built over
+};
+
+// bounding_box_of(i, box) fills in the bounds of object i and returns false if it has none
+template <typename bounds_fn>
+inline vector<bvh_primitive> make_bvh_primitives(size_t count, bounds_fn bounding_box_of)
+{
+    vector<bvh_primitive> prims(count);
+    bvh_for_chunks(0, count, bvh_chunk_count(0, count), [&](size_t, size_t chunk_start, size_t chunk_end) {
+        for (size_t i = chunk_start; i < chunk_end; i++)
+        {
+            if (!bounding_box_of(i, prims[i].box))
+                std::cerr << "No bounding box in BVH constructor.\n";
+            prims[i].centroid = prims[i].box.centroid();
+            prims[i].index = i;
+        }
+    });
+    return prims;
+}
+
+// union of box_of(prims[i]) over [start, end), reduced in parallel chunks for large ranges
+template <typename box_fn>
+inline aabb reduce_bounds(const vector<bvh_primitive>& prims, size_t start, size_t end, box_fn box_of)
+{
+    size_t chunk_count = bvh_chunk_count(start, end);
+    vector<aabb> chunk_bounds(chunk_count);
+    bvh_for_chunks(start, end, chunk_count, [&](size_t chunk, size_t chunk_start, size_t chunk_end) {
+        aabb bounds = box_of(prims[chunk_start]);
+        for (size_t i = chunk_start + 1; i < chunk_end; i++)
+            bounds = surrounding_box(bounds, box_of(prims[i]));
+        chunk_bounds[chunk] = bounds;
+    });
+
+    aabb bounds = chunk_bounds[0];
+    for (size_t c = 1; c < chunk_count; c++)
+        bounds = surrounding_box(bounds, chunk_bounds[c]);
+    return bounds;
+}
+
+inline aabb primitive_bounds(const vector<bvh_primitive>& prims, size_t start, size_t end)
+{
+    return reduce_bounds(prims, start, end, [](const bvh_primitive& p) { return p.box; });
+}
+
+inline aabb centroid_bounds(const vector<bvh_primitive>& prims, size_t start, size_t end)
+{
+    return reduce_bounds(prims, start, end, [](const bvh_primitive& p) { return aabb(p.centroid, p.centroid); });
+}
+
+inline size_t bvh_median_split(vector<bvh_primitive>& prims, size_t start, size_t end, int axis)
+{
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+        [axis](const bvh_primitive& a, const bvh_primitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+    return mid;
+}
+
+// Binned SAH (Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies", 2007): drop the centroids
+// into BVH_SAH_BINS buckets per axis and evaluate the cost of splitting between each pair of adjacent buckets.
+inline size_t bvh_sah_split(vector<bvh_primitive>& prims, size_t start, size_t end, const aabb& cbounds)
+{
+    struct bin
+    {
+        aabb box;
+        size_t count = 0;
+    };
+
+    struct axis_bins
+    {
+        bin bins[3][BVH_SAH_BINS];
+    };
+
+    double scale[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = cbounds.max()[axis] - cbounds.min()[axis];
+        scale[axis] = extent > 0 ? BVH_SAH_BINS / extent : 0;
+    }
+
+    // bin all three axes in one pass over the objects; large ranges are binned in chunks on separate threads
+    size_t chunk_count = bvh_chunk_count(start, end);
+    vector<axis_bins> chunk_bins(chunk_count);
+    bvh_for_chunks(start, end, chunk_count, [&](size_t chunk, size_t chunk_start, size_t chunk_end) {
+        axis_bins& result = chunk_bins[chunk];
+        for (size_t i = chunk_start; i < chunk_end; i++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int b = std::min(static_cast<int>((prims[i].centroid[axis] - cbounds.min()[axis]) * scale[axis]), BVH_SAH_BINS - 1);
+                bin& target = result.bins[axis][b];
+                target.box = target.count ? surrounding_box(target.box, prims[i].box) : prims[i].box;
+                target.count++;
+            }
+        }
+    });
+
+    for (size_t c = 1; c < chunk_count; c++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int b = 0; b < BVH_SAH_BINS; b++)
+            {
+                bin& target = chunk_bins[0].bins[axis][b];
+                const bin& source = chunk_bins[c].bins[axis][b];
+                if (source.count)
+                    target.box = target.count ? surrounding_box(target.box, source.box) : source.box;
+                target.count += source.count;
+            }
+        }
+    }
+
+    double best_cost = INF;
+    int best_axis = -1;
+    int best_bin = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (scale[axis] == 0)
+            continue;
+
+        const bin* bins = chunk_bins[0].bins[axis];
+
+        // sweep from the right to get the area and count of everything right of each split plane
+        double right_area[BVH_SAH_BINS];
+        size_t right_count[BVH_SAH_BINS];
+        aabb acc;
+        size_t count = 0;
+        for (int b = BVH_SAH_BINS - 1; b > 0; b--)
+        {
+            if (bins[b].count)
+                acc = count ? surrounding_box(acc, bins[b].box) : bins[b].box;
+            count += bins[b].count;
+            right_area[b] = count ? surface_area(acc) : 0;
+            right_count[b] = count;
+        }
+
+        // then from the left, evaluating the split between bin b - 1 and bin b
+        count = 0;
+        for (int b = 1; b < BVH_SAH_BINS; b++)
+        {
+            if (bins[b - 1].count)
+                acc = count ? surrounding_box(acc, bins[b - 1].box) : bins[b - 1].box;
+            count += bins[b - 1].count;
+            if (count == 0 || right_count[b] == 0)
+                continue;
+
+            double cost = surface_area(acc) * count + right_area[b] * right_count[b];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    // all centroids coincide, nothing to gain from SAH
+    if (best_axis < 0)
+        return bvh_median_split(prims, start, end, cbounds.longest_axis());
+
+    double lo = cbounds.min()[best_axis];
+    auto mid = std::partition(prims.begin() + start, prims.begin() + end, [&](const bvh_primitive& p) {
+        return std::min(static_cast<int>((p.centroid[best_axis] - lo) * scale[best_axis]), BVH_SAH_BINS - 1) < best_bin;
+    });
+    return mid - prims.begin();
+}
+
+// reorders prims[start, end) and returns the index where the right child's range begins
+inline size_t bvh_split(vector<bvh_primitive>& prims, size_t start, size_t end, bvh_split_method method)
+{
+    aabb cbounds = centroid_bounds(prims, start, end);
+    if (method == bvh_split_method::sah && end - start > 2)
+        return bvh_sah_split(prims, start, end, cbounds);
+    return bvh_median_split(prims, start, end, cbounds.longest_axis());
+}
+
+// Bounding volume hierarchy: a binary tree of boxes over the scene's objects. A ray only descends into
+// children whose box it hits, so the cost of hit() grows with log(object count) instead of linearly.
+struct bvh_node : public hittable
+{
+    shared_ptr<hittable> left;
+    shared_ptr<hittable> right;
+    aabb box;
+
+    bvh_node() {}
+    // stats, if given, receives the node count, expected SAH cost and build time of the tree
+    bvh_node(const hittable_list& list, bvh_split_method method = bvh_split_method::sah, bvh_build_stats* stats = nullptr);
+
+    bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+    bool bounding_box(aabb& output_box) const override;
+
+private:
+    // returns the subtree's area-weighted cost, see bvh_build_stats::sah_cost
+    double build(const vector<shared_ptr<hittable>>& objects, vector<bvh_primitive>& prims, size_t start, size_t end,
+                 bvh_split_method method, size_t& node_count);
+};
+
+bvh_node::bvh_node(const hittable_list& list, bvh_split_method method, bvh_build_stats* stats)
+{
+    // an empty list leaves both children null, which hit and bounding_box treat as an empty tree
+    const auto& objects = list.objects();
+    if (objects.empty())
+        return;
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    vector<bvh_primitive> prims = make_bvh_primitives(objects.size(), [&](size_t i, aabb& box) {
+        return objects[i]->bounding_box(box);
+    });
+    size_t node_count = 0;
+    double cost = build(objects, prims, 0, prims.size(), method, node_count);
+
+    if (stats)
+    {
+        stats->node_count = node_count;
+        stats->object_count = objects.size();
+        double root_area = surface_area(box);
+        stats->sah_cost = root_area > 0 ? cost / root_area : 0;
+        stats->build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+}
+
+double bvh_node::build(const vector<shared_ptr<hittable>>& objects, vector<bvh_primitive>& prims, size_t start, size_t end,
+                       bvh_split_method method, size_t& node_count)
+{
+    node_count++;
+
+    size_t span = end - start;
+    if (span == 1)
+    {
+        left = right = objects[prims[start].index];
+        box = prims[start].box;
+        return surface_area(box) * (BVH_TRAVERSAL_COST + 2 * BVH_INTERSECT_COST);
+    }
+
+    size_t mid = span == 2 ? start + 1 : bvh_split(prims, start, end, method);
+
+    // single objects hang directly off this node instead of getting a one-object node of their own
+    double children_cost = 0;
+    int leaf_children = 0;
+    aabb left_box, right_box;
+
+    // a large right subtree is built on its own thread meanwhile; the two halves only touch their own range of prims
+    shared_ptr<bvh_node> right_node;
+    size_t right_node_count = 0;
+    std::future<double> right_cost;
+    if (end - mid > 1)
+    {
+        right_node = make_shared<bvh_node>();
+        right_cost = bvh_spawn_subtree(mid, end, [&] {
+            return right_node->build(objects, prims, mid, end, method, right_node_count);
+        });
+    }
+
+    if (mid - start == 1)
+    {
+        left = objects[prims[start].index];
+        left_box = prims[start].box;
+        leaf_children++;
+    }
+    else
+    {
+        auto node = make_shared<bvh_node>();
+        children_cost += node->build(objects, prims, start, mid, method, node_count);
+        left_box = node->box;
+        left = node;
+    }
+    if (end - mid == 1)
+    {
+        right = objects[prims[mid].index];
+        right_box = prims[mid].box;
+        leaf_children++;
+    }
+    else
+    {
+        children_cost += right_cost.valid() ? right_cost.get()
+                                            : right_node->build(objects, prims, mid, end, method, right_node_count);
+        node_count += right_node_count;
+        right_box = right_node->box;
+        right = right_node;
+    }
+
+    box = surrounding_box(left_box, right_box);
+    return surface_area(box) * (BVH_TRAVERSAL_COST + leaf_children * BVH_INTERSECT_COST) + children_cost;
+}
+
+bool bvh_node::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+    if (!left)
+        return false;
+
+    RT_STAT_INC(nodes_visited);
+    if (!box.hit(r, t_min, t_max))
+        return false;
+
+    bool hit_left = left->hit(r, t_min, t_max, rec);
+    // only accept a right hit if it's closer than the left one
+    bool hit_right = right->hit(r, t_min, hit_left ? rec.time : t_max, rec);
+
+    return hit_left || hit_right;
+}
+
+bool bvh_node::bounding_box(aabb& output_box) const
+{
+    if (!left)
+        return false;
+
+    output_box = box;
+    return true;
+}
+
+#endif // RT_BVH
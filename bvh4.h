@@ -0,0 +1,612 @@
+#ifndef RT_BVH4
+#define RT_BVH4
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define RT_BVH4_SSE
+#include <immintrin.h>
+#endif
+
+#include "bvh.h"
+#include "linear_bvh.h"
+
+const uint32_t BVH4_EMPTY_CHILD = UINT32_MAX;
+// Deepest path a bvh4 can have. The builder switches to median splits a third of the way down; those at least
+// halve the largest child every level, so the remaining 32 levels are enough for 2^32 objects.
+const int BVH4_MAX_DEPTH = 48;
+// traversal pops one node and pushes up to four, so the stack grows by at most three entries per level
+const int BVH4_STACK_SIZE = 3 * BVH4_MAX_DEPTH + 1;
+// The box tests run in float and are kept conservative as in PBRT (Pharr et al., section 3.9.2), so a ray that
+// grazes a box near a sphere's tangent point never misses the box: t_min is rounded down and t_max up, the
+// origin is rounded towards whichever side makes a slab wider, and the exit distance is grown by 1 + 2 * gamma(3)
+// for the three roundings (inverse direction, subtraction and product) in each slab distance. gamma(3) is
+// 3u / (1 - 3u) with u = 2^-24, which makes that just over 1 + 3 * 2^-23, so the next float up is used.
+const float BVH4_EXIT_SCALE = 1 + 4 * 0x1p-23f;
+
+// Node of a 4-ary BVH. Child bounds are stored structure-of-arrays, [min/max][axis][child], so one SSE register
+// holds the same plane of all four children and a single sequence of vector ops slab-tests them together.
+struct alignas(64) bvh4_node
+{
+    float bounds[2][3][4];
+    // leaf children: index of the first primitive; interior children: node index; unused slots: BVH4_EMPTY_CHILD
+    uint32_t child[4];
+    uint8_t count[4]; // primitives in each leaf child, 0 for interior children and unused slots
+};
+
+static_assert(sizeof(bvh4_node) == 128, "bvh4_node should fill exactly two cache lines");
+
+// 4-ary BVH (a "QBVH", Dammertz et al. 2008). Each node's range is split up to three times with the same split
+// methods as the binary BVHs, which halves the tree depth and replaces four scalar box tests with one SIMD test.
+// Like linear_bvh, primitives are kept in leaf order in storage and intersected without virtual dispatch.
+template <typename primitive, typename storage = primitive_array<primitive>>
+struct bvh4 : public hittable
+{
+    vector<bvh4_node> nodes;
+    storage prims;
+    aabb bounds;
+
+    bvh4() {}
+    // stats, if given, receives the node count, expected SAH cost and build time of the tree
+    bvh4(const vector<primitive>& objects, bvh_split_method method = bvh_split_method::sah, bvh_build_stats* stats = nullptr);
+
+    bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+    // Traverses the tree once for the whole packet: each visited node's four child boxes are tested against
+    // every ray still headed into it (four rays per SIMD instruction), and a child is entered by the rays that
+    // hit its box. Leaves are intersected with storage::hit_packet.
+    void hit_packet(ray_packet& packet) const override;
+    bool bounding_box(aabb& output_box) const override;
+
+private:
+    double build(const vector<primitive>& objects, vector<bvh_primitive>& refs, size_t start, size_t end,
+                 bvh_split_method method, int depth);
+    // appends a separately built tree's nodes and primitives, rebasing its child indices
+    void append_subtree(const bvh4& subtree);
+};
+
+template <typename primitive, typename storage>
+bvh4<primitive, storage>::bvh4(const vector<primitive>& objects, bvh_split_method method, bvh_build_stats* stats)
+{
+    if (objects.empty())
+        return;
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    vector<bvh_primitive> refs = make_bvh_primitives(objects.size(), [&](size_t i, aabb& box) {
+        return objects[i].bounding_box(box);
+    });
+    bounds = primitive_bounds(refs, 0, refs.size());
+
+    nodes.reserve(objects.size() / 2 + 1);
+    prims.reserve(objects.size());
+    double cost = build(objects, refs, 0, refs.size(), method, 0);
+
+    if (stats)
+    {
+        double root_area = surface_area(bounds);
+        stats->node_count = nodes.size();
+        stats->object_count = objects.size();
+        stats->sah_cost = root_area > 0 ? (root_area * BVH_TRAVERSAL_COST + cost) / root_area : 0;
+        stats->build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+}
+
+// Returns the area-weighted cost of the node's children (its own box test is charged by the parent, which tests
+// all four child boxes at once when it is visited).
+template <typename primitive, typename storage>
+double bvh4<primitive, storage>::build(const vector<primitive>& objects, vector<bvh_primitive>& refs, size_t start, size_t end,
+                              bvh_split_method method, int depth)
+{
+    size_t node_idx = nodes.size();
+    nodes.emplace_back();
+
+    // split the largest range in two until there are four children, or nothing left worth splitting
+    size_t range_start[4] = { start };
+    size_t range_end[4] = { end };
+    int child_count = 1;
+    while (child_count < 4)
+    {
+        int largest = -1;
+        for (int c = 0; c < child_count; c++)
+        {
+            size_t span = range_end[c] - range_start[c];
+            if (span > LINEAR_BVH_MAX_LEAF_SIZE && (largest < 0 || span > range_end[largest] - range_start[largest]))
+                largest = c;
+        }
+        if (largest < 0)
+            break;
+
+        bvh_split_method level_method = depth >= BVH4_MAX_DEPTH / 3 ? bvh_split_method::median : method;
+        size_t mid = bvh_split(refs, range_start[largest], range_end[largest], level_method);
+
+        for (int c = child_count; c > largest + 1; c--)
+        {
+            range_start[c] = range_start[c - 1];
+            range_end[c] = range_end[c - 1];
+        }
+        range_start[largest + 1] = mid;
+        range_end[largest + 1] = range_end[largest];
+        range_end[largest] = mid;
+        child_count++;
+    }
+
+    aabb child_box[4];
+    for (int c = 0; c < child_count; c++)
+        child_box[c] = primitive_bounds(refs, range_start[c], range_end[c]);
+
+    // Large interior children are built into trees of their own on other threads and appended in child order
+    // below. Each only touches its own range of refs.
+    bvh4 subtree[4];
+    std::future<double> subtree_cost[4];
+    for (int c = 0; c < child_count; c++)
+    {
+        if (range_end[c] - range_start[c] > LINEAR_BVH_MAX_LEAF_SIZE)
+            subtree_cost[c] = bvh_spawn_subtree(range_start[c], range_end[c], [&, c] {
+                return subtree[c].build(objects, refs, range_start[c], range_end[c], method, depth + 1);
+            });
+    }
+
+    double cost = 0;
+    for (int c = 0; c < 4; c++)
+    {
+        if (c >= child_count)
+        {
+            // an inverted box no ray can hit
+            for (int a = 0; a < 3; a++)
+            {
+                nodes[node_idx].bounds[0][a][c] = std::numeric_limits<float>::infinity();
+                nodes[node_idx].bounds[1][a][c] = -std::numeric_limits<float>::infinity();
+            }
+            nodes[node_idx].child[c] = BVH4_EMPTY_CHILD;
+            nodes[node_idx].count[c] = 0;
+            continue;
+        }
+
+        const aabb& box = child_box[c];
+        linear_bvh_node rounded;
+        set_node_bounds(rounded, box);
+        for (int a = 0; a < 3; a++)
+        {
+            nodes[node_idx].bounds[0][a][c] = rounded.bounds[0][a];
+            nodes[node_idx].bounds[1][a][c] = rounded.bounds[1][a];
+        }
+
+        size_t span = range_end[c] - range_start[c];
+        if (span <= LINEAR_BVH_MAX_LEAF_SIZE)
+        {
+            nodes[node_idx].child[c] = static_cast<uint32_t>(prims.size());
+            nodes[node_idx].count[c] = static_cast<uint8_t>(span);
+            for (size_t i = range_start[c]; i < range_end[c]; i++)
+                prims.push_back(objects[refs[i].index]);
+            cost += surface_area(box) * span * BVH_INTERSECT_COST;
+        }
+        else
+        {
+            nodes[node_idx].child[c] = static_cast<uint32_t>(nodes.size());
+            nodes[node_idx].count[c] = 0;
+            cost += surface_area(box) * BVH_TRAVERSAL_COST;
+            if (subtree_cost[c].valid())
+            {
+                cost += subtree_cost[c].get();
+                append_subtree(subtree[c]);
+            }
+            else
+            {
+                cost += build(objects, refs, range_start[c], range_end[c], method, depth + 1);
+            }
+        }
+    }
+
+    return cost;
+}
+
+template <typename primitive, typename storage>
+void bvh4<primitive, storage>::append_subtree(const bvh4& subtree)
+{
+    uint32_t node_base = static_cast<uint32_t>(nodes.size());
+    uint32_t prim_base = static_cast<uint32_t>(prims.size());
+
+    for (bvh4_node node : subtree.nodes)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            if (node.count[c] > 0)
+                node.child[c] += prim_base;
+            else if (node.child[c] != BVH4_EMPTY_CHILD)
+                node.child[c] += node_base;
+        }
+        nodes.push_back(node);
+    }
+    prims.append(subtree.prims);
+}
+
+template <typename primitive, typename storage>
+bool bvh4<primitive, storage>::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+    if (nodes.empty())
+        return false;
+
+    point3 orig = r.origin();
+    vec3 dir = r.direction();
+    float inv_dir[3] = { static_cast<float>(1.0 / dir.x()), static_cast<float>(1.0 / dir.y()), static_cast<float>(1.0 / dir.z()) };
+    int dir_is_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+    // the origin rounded so that each slab's near distance can only come out smaller and its far one larger
+    float org_near[3], org_far[3];
+    for (int a = 0; a < 3; a++)
+    {
+        org_near[a] = dir_is_neg[a] ? float_below(orig[a]) : float_above(orig[a]);
+        org_far[a] = dir_is_neg[a] ? float_above(orig[a]) : float_below(orig[a]);
+    }
+    float t_min_f = float_below(t_min);
+    // only changes when a leaf narrows t_max, so it isn't rounded again for every node
+    float t_max_f = float_above(t_max);
+
+#ifdef RT_BVH4_SSE
+    __m128 org_near4[3] = { _mm_set1_ps(org_near[0]), _mm_set1_ps(org_near[1]), _mm_set1_ps(org_near[2]) };
+    __m128 org_far4[3] = { _mm_set1_ps(org_far[0]), _mm_set1_ps(org_far[1]), _mm_set1_ps(org_far[2]) };
+    __m128 inv_dir4[3] = { _mm_set1_ps(inv_dir[0]), _mm_set1_ps(inv_dir[1]), _mm_set1_ps(inv_dir[2]) };
+    __m128 t_min4 = _mm_set1_ps(t_min_f);
+    __m128 exit_scale4 = _mm_set1_ps(BVH4_EXIT_SCALE);
+#endif
+
+    // nodes are stacked with their entry distance, so ones behind a hit found since they were pushed are skipped
+    struct stack_entry
+    {
+        uint32_t node;
+        float t_near;
+    };
+    stack_entry stack[BVH4_STACK_SIZE];
+    int stack_size = 0;
+    uint32_t node_idx = 0;
+    bool hit_anything = false;
+
+    while (true)
+    {
+        const bvh4_node& node = nodes[node_idx];
+        RT_STAT_INC(nodes_visited);
+
+        float t_near[4];
+        int hit_mask = 0;
+#ifdef RT_BVH4_SSE
+        __m128 t0 = t_min4;
+        __m128 t1 = _mm_set1_ps(t_max_f);
+        for (int a = 0; a < 3; a++)
+        {
+            __m128 near_t = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[dir_is_neg[a]][a]), org_near4[a]), inv_dir4[a]);
+            __m128 far_t = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - dir_is_neg[a]][a]), org_far4[a]), inv_dir4[a]);
+            // operand order matters: max/min return the second operand if either is NaN (0 * inf on a slab edge)
+            t0 = _mm_max_ps(near_t, t0);
+            t1 = _mm_min_ps(far_t, t1);
+        }
+        t1 = _mm_mul_ps(t1, exit_scale4);
+        hit_mask = _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+        _mm_storeu_ps(t_near, t0);
+#else
+        for (int c = 0; c < 4; c++)
+        {
+            float t0 = t_min_f;
+            float t1 = t_max_f;
+            for (int a = 0; a < 3; a++)
+            {
+                float near_t = (node.bounds[dir_is_neg[a]][a][c] - org_near[a]) * inv_dir[a];
+                float far_t = (node.bounds[1 - dir_is_neg[a]][a][c] - org_far[a]) * inv_dir[a];
+                t0 = near_t > t0 ? near_t : t0;
+                t1 = far_t < t1 ? far_t : t1;
+            }
+            t1 *= BVH4_EXIT_SCALE;
+            t_near[c] = t0;
+            hit_mask |= (t0 <= t1) << c;
+        }
+#endif
+
+        // intersect leaf children right away, collect interior ones sorted far to near so the nearest is popped first
+        stack_entry visit[4];
+        int visit_count = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            // an empty slot's inverted box can still pass the test of a NaN ray
+            if (!(hit_mask & (1 << c)) || node.child[c] == BVH4_EMPTY_CHILD)
+                continue;
+
+            if (node.count[c] > 0)
+            {
+                if (prims.hit(node.child[c], node.count[c], r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max_f = float_above(t_max);
+                }
+                continue;
+            }
+
+            int pos = visit_count++;
+            while (pos > 0 && visit[pos - 1].t_near < t_near[c])
+            {
+                visit[pos] = visit[pos - 1];
+                pos--;
+            }
+            visit[pos] = { node.child[c], t_near[c] };
+        }
+
+        for (int i = 0; i < visit_count; i++)
+            stack[stack_size++] = visit[i];
+
+        // t_near may be a little past the true entry, by the same error t1 is grown for
+        do
+        {
+            if (stack_size == 0)
+                return hit_anything;
+            stack_size--;
+        } while (stack[stack_size].t_near > t_max_f * BVH4_EXIT_SCALE);
+        node_idx = stack[stack_size].node;
+    }
+}
+
+template <typename primitive, typename storage>
+void bvh4<primitive, storage>::hit_packet(ray_packet& packet) const
+{
+    if (nodes.empty() || packet.size == 0)
+        return;
+
+    // a node is stacked with the rays entering it and the nearest of their entry distances
+    struct stack_entry
+    {
+        uint32_t node;
+        uint32_t rays;
+        float t_near;
+    };
+    stack_entry stack[BVH4_STACK_SIZE];
+    int stack_size = 0;
+    uint32_t node_idx = 0;
+    uint32_t node_rays = packet.all();
+    float t_min = float_below(packet.t_min);
+    // packet.t_max rounded up, updated after each leaf like hit()'s
+    alignas(16) float t_max_f[RAY_PACKET_MAX];
+    for (uint32_t i = 0; i < RAY_PACKET_MAX; i++)
+        t_max_f[i] = float_above(packet.t_max[i]);
+
+    // When every ray's direction has the same signs (and no zero components), the packet as a whole is one
+    // ray with an interval of origins and inverse directions, and a box test of that interval (Boulos et al.
+    // 2006) bounds every one of its rays' tests: the corners of the intervals give the nearest entry and
+    // farthest exit any ray can have, and float rounding is monotonic so this holds for the rounded values as
+    // well. One such test per node replaces a test per ray, at the cost of entering a few children that only
+    // the interval hits; leaves still intersect each ray on its own, so the hits are the same.
+    float org_min[3], org_max[3], inv_dir_min[3], inv_dir_max[3];
+    int dir_is_neg[3];
+    bool interval = true;
+    for (int a = 0; a < 3; a++)
+    {
+        org_min[a] = packet.org_lo_f[a][0];
+        org_max[a] = packet.org_hi_f[a][0];
+        inv_dir_min[a] = inv_dir_max[a] = packet.inv_dir_f[a][0];
+        for (uint32_t i = 0; i < packet.size; i++)
+        {
+            // min and max would quietly drop a NaN, which bounds nothing
+            interval = interval && std::isfinite(packet.org_lo_f[a][i]) && std::isfinite(packet.inv_dir_f[a][i]);
+            org_min[a] = std::min(org_min[a], packet.org_lo_f[a][i]);
+            org_max[a] = std::max(org_max[a], packet.org_hi_f[a][i]);
+            inv_dir_min[a] = std::min(inv_dir_min[a], packet.inv_dir_f[a][i]);
+            inv_dir_max[a] = std::max(inv_dir_max[a], packet.inv_dir_f[a][i]);
+        }
+        dir_is_neg[a] = inv_dir_max[a] < 0;
+        interval = interval && (inv_dir_min[a] > 0 || inv_dir_max[a] < 0);
+    }
+
+#ifdef RT_BVH4_SSE
+    // origin corner giving each axis' nearest entry (the farthest along the direction) and farthest exit
+    __m128 org_near4[3], org_far4[3], inv_dir_min4[3], inv_dir_max4[3];
+    for (int a = 0; a < 3; a++)
+    {
+        org_near4[a] = _mm_set1_ps(dir_is_neg[a] ? org_min[a] : org_max[a]);
+        org_far4[a] = _mm_set1_ps(dir_is_neg[a] ? org_max[a] : org_min[a]);
+        inv_dir_min4[a] = _mm_set1_ps(inv_dir_min[a]);
+        inv_dir_max4[a] = _mm_set1_ps(inv_dir_max[a]);
+    }
+    __m128 exit_scale4 = _mm_set1_ps(BVH4_EXIT_SCALE);
+#endif
+
+    while (true)
+    {
+        const bvh4_node& node = nodes[node_idx];
+        RT_STAT_INC(nodes_visited);
+
+        uint32_t child_rays[4] = { 0, 0, 0, 0 };
+        const float inf = std::numeric_limits<float>::infinity();
+        float child_near[4] = { inf, inf, inf, inf };
+
+        if (interval)
+        {
+            // farthest any of the node's rays still looks
+            float t_max = -std::numeric_limits<float>::infinity();
+            for (uint32_t i = 0; i < packet.size; i++)
+                t_max = (node_rays & (1u << i)) && t_max_f[i] > t_max ? t_max_f[i] : t_max;
+
+            int hit_mask = 0;
+#ifdef RT_BVH4_SSE
+            __m128 t0 = _mm_set1_ps(t_min);
+            __m128 t1 = _mm_set1_ps(t_max);
+            for (int a = 0; a < 3; a++)
+            {
+                __m128 near_d = _mm_sub_ps(_mm_load_ps(node.bounds[dir_is_neg[a]][a]), org_near4[a]);
+                __m128 far_d = _mm_sub_ps(_mm_load_ps(node.bounds[1 - dir_is_neg[a]][a]), org_far4[a]);
+                __m128 near_t = _mm_min_ps(_mm_mul_ps(near_d, inv_dir_min4[a]), _mm_mul_ps(near_d, inv_dir_max4[a]));
+                __m128 far_t = _mm_max_ps(_mm_mul_ps(far_d, inv_dir_min4[a]), _mm_mul_ps(far_d, inv_dir_max4[a]));
+                t0 = _mm_max_ps(near_t, t0);
+                t1 = _mm_min_ps(far_t, t1);
+            }
+            t1 = _mm_mul_ps(t1, exit_scale4);
+            hit_mask = _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+            _mm_storeu_ps(child_near, t0);
+#else
+            for (int c = 0; c < 4; c++)
+            {
+                float t0 = t_min;
+                float t1 = t_max;
+                for (int a = 0; a < 3; a++)
+                {
+                    float near_d = node.bounds[dir_is_neg[a]][a][c] - (dir_is_neg[a] ? org_min[a] : org_max[a]);
+                    float far_d = node.bounds[1 - dir_is_neg[a]][a][c] - (dir_is_neg[a] ? org_max[a] : org_min[a]);
+                    t0 = std::max(std::min(near_d * inv_dir_min[a], near_d * inv_dir_max[a]), t0);
+                    t1 = std::min(std::max(far_d * inv_dir_min[a], far_d * inv_dir_max[a]), t1);
+                }
+                t1 *= BVH4_EXIT_SCALE;
+                child_near[c] = t0;
+                hit_mask |= (t0 <= t1) << c;
+            }
+#endif
+            // as in hit(), an empty slot's inverted box can still pass a test with NaNs in it
+            for (int c = 0; c < 4; c++)
+                child_rays[c] = (hit_mask & (1 << c)) && node.child[c] != BVH4_EMPTY_CHILD ? node_rays : 0;
+        }
+        else
+        {
+            // mixed directions: each ray is tested on its own, four at a time
+            for (uint32_t group = 0; group < packet.size; group += 4)
+            {
+                uint32_t group_rays = (node_rays >> group) & 0xf;
+                if (!group_rays)
+                    continue;
+
+#ifdef RT_BVH4_SSE
+                __m128 org_lo4[3], org_hi4[3], inv_dir4[3], dir_is_neg4[3];
+                for (int a = 0; a < 3; a++)
+                {
+                    org_lo4[a] = _mm_load_ps(&packet.org_lo_f[a][group]);
+                    org_hi4[a] = _mm_load_ps(&packet.org_hi_f[a][group]);
+                    inv_dir4[a] = _mm_load_ps(&packet.inv_dir_f[a][group]);
+                    dir_is_neg4[a] = _mm_cmplt_ps(inv_dir4[a], _mm_setzero_ps());
+                }
+                __m128 t_max4 = _mm_load_ps(&t_max_f[group]);
+
+                for (int c = 0; c < 4; c++)
+                {
+                    if (node.child[c] == BVH4_EMPTY_CHILD)
+                        continue;
+
+                    // Which plane of each slab is near differs between rays, so both are computed and selected. For
+                    // either sign of the direction, rounding the origin up can only widen the slab at the min plane
+                    // and rounding it down at the max plane.
+                    __m128 t0 = _mm_set1_ps(t_min);
+                    __m128 t1 = t_max4;
+                    for (int a = 0; a < 3; a++)
+                    {
+                        __m128 lo_t = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds[0][a][c]), org_hi4[a]), inv_dir4[a]);
+                        __m128 hi_t = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds[1][a][c]), org_lo4[a]), inv_dir4[a]);
+                        __m128 near_t = _mm_or_ps(_mm_and_ps(dir_is_neg4[a], hi_t), _mm_andnot_ps(dir_is_neg4[a], lo_t));
+                        __m128 far_t = _mm_or_ps(_mm_and_ps(dir_is_neg4[a], lo_t), _mm_andnot_ps(dir_is_neg4[a], hi_t));
+                        // same operand order as hit(), for the same NaN handling
+                        t0 = _mm_max_ps(near_t, t0);
+                        t1 = _mm_min_ps(far_t, t1);
+                    }
+                    t1 = _mm_mul_ps(t1, exit_scale4);
+                    uint32_t hits = _mm_movemask_ps(_mm_cmple_ps(t0, t1)) & group_rays;
+                    if (!hits)
+                        continue;
+
+                    alignas(16) float t_near[4];
+                    _mm_store_ps(t_near, t0);
+                    child_rays[c] |= hits << group;
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if ((hits & (1u << lane)) && t_near[lane] < child_near[c])
+                            child_near[c] = t_near[lane];
+                    }
+                }
+#else
+                for (uint32_t i = group; i < group + 4; i++)
+                {
+                    if (!(group_rays & (1u << (i - group))))
+                        continue;
+
+                    for (int c = 0; c < 4; c++)
+                    {
+                        if (node.child[c] == BVH4_EMPTY_CHILD)
+                            continue;
+
+                        float t0 = t_min;
+                        float t1 = t_max_f[i];
+                        for (int a = 0; a < 3; a++)
+                        {
+                            float inv_dir = packet.inv_dir_f[a][i];
+                            int neg = inv_dir < 0;
+                            float org_near = neg ? packet.org_lo_f[a][i] : packet.org_hi_f[a][i];
+                            float org_far = neg ? packet.org_hi_f[a][i] : packet.org_lo_f[a][i];
+                            float near_t = (node.bounds[neg][a][c] - org_near) * inv_dir;
+                            float far_t = (node.bounds[1 - neg][a][c] - org_far) * inv_dir;
+                            t0 = near_t > t0 ? near_t : t0;
+                            t1 = far_t < t1 ? far_t : t1;
+                        }
+                        t1 *= BVH4_EXIT_SCALE;
+                        if (t0 <= t1)
+                        {
+                            child_rays[c] |= 1u << i;
+                            child_near[c] = t0 < child_near[c] ? t0 : child_near[c];
+                        }
+                    }
+                }
+#endif
+            }
+        }
+
+        // as in hit(): leaves right away, interior children stacked far to near
+        stack_entry visit[4];
+        int visit_count = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            if (!child_rays[c])
+                continue;
+
+            if (node.count[c] > 0)
+            {
+                prims.hit_packet(node.child[c], node.count[c], packet, child_rays[c]);
+                for (uint32_t i = 0; i < packet.size; i++)
+                {
+                    if (child_rays[c] & (1u << i))
+                        t_max_f[i] = float_above(packet.t_max[i]);
+                }
+                continue;
+            }
+
+            int pos = visit_count++;
+            while (pos > 0 && visit[pos - 1].t_near < child_near[c])
+            {
+                visit[pos] = visit[pos - 1];
+                pos--;
+            }
+            visit[pos] = { node.child[c], child_rays[c], child_near[c] };
+        }
+
+        for (int i = 0; i < visit_count; i++)
+            stack[stack_size++] = visit[i];
+
+        // skip nodes that every one of their rays has found a hit in front of since they were pushed
+        while (true)
+        {
+            if (stack_size == 0)
+                return;
+            const stack_entry& top = stack[--stack_size];
+            bool ahead = false;
+            for (uint32_t i = 0; i < packet.size && !ahead; i++)
+                ahead = (top.rays & (1u << i)) && top.t_near <= t_max_f[i] * BVH4_EXIT_SCALE;
+            if (ahead)
+                break;
+        }
+        node_idx = stack[stack_size].node;
+        node_rays = stack[stack_size].rays;
+    }
+}
+
+template <typename primitive, typename storage>
+bool bvh4<primitive, storage>::bounding_box(aabb& output_box) const
+{
+    if (nodes.empty())
+        return false;
+
+    output_box = bounds;
+    return true;
+}
+
+#endif // RT_BVH4
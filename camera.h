@@ -20,6 +20,7 @@ struct camera
         point3 look_at,
         vec3 _up,
         double vert_fov_deg,
+        double aspect_ratio,
         double aperture,
         double focus_dist
     )
@@ -27,7 +28,7 @@ struct camera
         double theta = degrees_to_rad(vert_fov_deg);
         double half_height = tan(theta/2); // considering that adjacent side is 1 (i.e. viewing z=-1 plane)
         viewport_height = 2.0 * half_height;
-        viewport_width = ASPECT_RATIO * viewport_height;
+        viewport_width = aspect_ratio * viewport_height;
 
         w = unit_vector(_origin - look_at);
         u = unit_vector(cross(_up, w));
@@ -41,8 +42,8 @@ struct camera
         lens_radius = aperture / 2;
     }
 
-    ray get_ray(double s, double t) const {
-        vec3 rd = lens_radius * random_in_unit_disk();
+    ray get_ray(double s, double t, rng& gen) const {
+        vec3 rd = lens_radius * random_in_unit_disk(gen);
         vec3 offset = u * rd.x() + v * rd.y();
 
         return ray(origin + offset, btm_left_pt + s*right + t*up - origin - offset);
@@ -0,0 +1,139 @@
+#ifndef RT_CHECKPOINT
+#define RT_CHECKPOINT
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "settings.h"
+
+// Checkpoint file layout, all in native byte order (checkpoints are for resuming on the same machine):
+//   char[8]  CHECKPOINT_MAGIC
+//   uint64   render_settings_hash of the render
+//   uint32   width, height
+//   uint64   samples taken
+//   float    radiance sums, 3 per pixel
+//   uint32   sample count per pixel
+//   double   luminance mean and m2 per pixel, adaptive renders only
+const char CHECKPOINT_MAGIC[8] = { 'R', 'T', 'C', 'K', 'P', 'T', '0', '1' };
+
+template <typename T>
+inline void write_raw(std::ofstream& file, const T* data, size_t count)
+{
+    file.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <typename T>
+inline void read_raw(std::ifstream& file, T* data, size_t count)
+{
+    file.read(reinterpret_cast<char*>(data), count * sizeof(T));
+}
+
+// Saves everything render() needs to carry on. Like write_png, the file is written under a temporary name and
+// renamed over path, so a render killed while checkpointing still leaves the previous checkpoint intact.
+inline bool write_checkpoint(const std::string& path, const renderer& render)
+{
+    trace_scope trace("checkpoint");
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        uint64_t hash = render_settings_hash(render.settings);
+        uint32_t size[2] = { render.accum.width, render.accum.height };
+
+        write_raw(file, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        write_raw(file, &hash, 1);
+        write_raw(file, size, 2);
+        write_raw(file, &render.samples_taken, 1);
+        write_raw(file, render.accum.radiance.data(), render.accum.radiance.size());
+        write_raw(file, render.accum.samples.data(), render.accum.samples.size());
+        if (render.settings.adaptive)
+        {
+            for (const pixel_estimate& estimate : render.estimates)
+            {
+                double stats[2] = { estimate.mean, estimate.m2 };
+                write_raw(file, stats, 2);
+            }
+        }
+
+        file.flush();
+        if (!file)
+        {
+            std::cerr << "Can't write checkpoint '" << temp_path << "'\n";
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+
+    if (!replace_file(temp_path, path))
+    {
+        std::cerr << "Can't replace checkpoint '" << path << "'\n";
+        return false;
+    }
+    return true;
+}
+
+// Restores a render saved by write_checkpoint. Fails, leaving render untouched, if the checkpoint is of a
+// render with different settings.
+inline bool read_checkpoint(const std::string& path, renderer& render)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Can't open checkpoint '" << path << "'\n";
+        return false;
+    }
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    uint64_t hash = 0;
+    uint32_t size[2] = { 0, 0 };
+    uint64_t samples_taken = 0;
+    read_raw(file, magic, sizeof(magic));
+    read_raw(file, &hash, 1);
+    read_raw(file, size, 2);
+    read_raw(file, &samples_taken, 1);
+
+    if (!file || !std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC))
+    {
+        std::cerr << "'" << path << "' is not a checkpoint\n";
+        return false;
+    }
+    if (hash != render_settings_hash(render.settings) || size[0] != render.accum.width || size[1] != render.accum.height)
+    {
+        std::cerr << "Checkpoint '" << path << "' is of a render with different settings\n";
+        return false;
+    }
+
+    hdr_buffer accum(size[0], size[1]);
+    vector<pixel_estimate> estimates(accum.pixel_count());
+    read_raw(file, accum.radiance.data(), accum.radiance.size());
+    read_raw(file, accum.samples.data(), accum.samples.size());
+    for (size_t i = 0; i < estimates.size(); i++)
+    {
+        estimates[i].samples = accum.samples[i];
+        if (render.settings.adaptive)
+        {
+            double stats[2];
+            read_raw(file, stats, 2);
+            estimates[i].mean = stats[0];
+            estimates[i].m2 = stats[1];
+        }
+    }
+
+    if (!file)
+    {
+        std::cerr << "Checkpoint '" << path << "' is truncated\n";
+        return false;
+    }
+
+    render.accum = std::move(accum);
+    render.estimates = std::move(estimates);
+    render.samples_taken = samples_taken;
+    return true;
+}
+
+#endif // RT_CHECKPOINT
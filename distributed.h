@@ -0,0 +1,298 @@
+#ifndef RT_DISTRIBUTED
+#define RT_DISTRIBUTED
+
+// Coordinator/worker rendering over local sockets, POSIX only (fork, socketpair, poll).
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_DISTRIBUTED_POSIX
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "renderer.h"
+#include "settings.h"
+#include "tile.h"
+
+// sent instead of a tile index to tell a worker to exit
+const uint32_t WORKER_QUIT = UINT32_MAX;
+
+// Reads or writes exactly size bytes, retrying short transfers. False on error or end of stream.
+inline bool read_all(int fd, void* data, size_t size)
+{
+    char* p = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool write_all(int fd, const void* data, size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        // MSG_NOSIGNAL: a peer that died is reported as an error instead of killing us with SIGPIPE
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Renders every sample of one tile, returning the float radiance sum of each of its pixels row by row
+// (PIXEL_COMP_COUNT per pixel), which is both the wire format and what hdr_buffer stores.
+inline vector<float> render_tile(const render_settings& settings, const camera& cam, const hittable& world, const tile& t)
+{
+    vector<float> sums;
+    sums.reserve(size_t(t.width()) * t.height() * PIXEL_COMP_COUNT);
+    for (uint32_t y = t.y0; y < t.y1; y++)
+        for (uint32_t x = t.x0; x < t.x1; x++)
+        {
+            color sum = render_pixel(settings, cam, world, x, y, 0, settings.samples_per_pixel);
+            for (int comp = 0; comp < PIXEL_COMP_COUNT; comp++)
+                sums.push_back(static_cast<float>(sum[comp]));
+        }
+    return sums;
+}
+
+inline void add_tile(hdr_buffer& accum, const tile& t, const vector<float>& sums, uint32_t samples)
+{
+    size_t i = 0;
+    for (uint32_t y = t.y0; y < t.y1; y++)
+        for (uint32_t x = t.x0; x < t.x1; x++, i += PIXEL_COMP_COUNT)
+            accum.add(size_t(y) * accum.width + x, color(sums[i], sums[i + 1], sums[i + 2]), samples);
+}
+
+// Body of a worker process: renders the tiles it is sent until told to quit or the coordinator goes away.
+// Replies are the tile index followed by render_tile's sums.
+inline void worker_main(int fd, const render_settings& settings, const camera& cam, const hittable& world, const vector<tile>& tiles)
+{
+    uint32_t tile_idx;
+    while (read_all(fd, &tile_idx, sizeof(tile_idx)) && tile_idx < tiles.size())
+    {
+        vector<float> sums = render_tile(settings, cam, world, tiles[tile_idx]);
+        if (!write_all(fd, &tile_idx, sizeof(tile_idx)) || !write_all(fd, sums.data(), sums.size() * sizeof(float)))
+            break;
+    }
+}
+
+struct worker_process
+{
+    pid_t pid = -1;
+    int fd = -1;
+    bool alive = false;
+    int64_t current_tile = -1; // tile it is rendering, -1 when idle
+
+    uint32_t tiles_done = 0;
+    uint64_t samples = 0;
+    double busy_seconds = 0;
+    std::chrono::steady_clock::time_point tile_start;
+};
+
+// Renders the whole frame (samples_per_pixel of every pixel) in settings.workers worker processes, forked from
+// this one so they already have the scene. The coordinator hands out one tile at a time to each worker and
+// collects the results; the tile of a worker that dies is handed to another, and if none are left the
+// coordinator renders the remaining tiles itself. The image is the same as a single process render.
+inline hdr_buffer render_distributed(const render_settings& settings, const camera& cam, const hittable& world)
+{
+    using clock = std::chrono::steady_clock;
+
+    hdr_buffer accum(settings.image_width, settings.image_height());
+    vector<tile> tiles = make_tiles(settings.image_width, settings.image_height(), settings.tile_size);
+    vector<worker_process> workers(settings.workers);
+
+    for (worker_process& w : workers)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            std::cerr << "Can't create worker socket\n";
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(fds[0]);
+            for (const worker_process& other : workers)
+                if (other.fd >= 0)
+                    close(other.fd);
+            worker_main(fds[1], settings, cam, world, tiles);
+            // skip destructors and atexit handlers, they belong to the coordinator
+            _exit(0);
+        }
+
+        close(fds[1]);
+        if (pid < 0)
+        {
+            std::cerr << "Can't start worker process\n";
+            close(fds[0]);
+            break;
+        }
+        w.pid = pid;
+        w.fd = fds[0];
+        w.alive = true;
+    }
+
+    std::deque<uint32_t> pending;
+    for (uint32_t i = 0; i < tiles.size(); i++)
+        pending.push_back(i);
+    size_t tiles_done = 0;
+
+    auto retire = [&](worker_process& w) {
+        std::cerr << "\nWorker " << w.pid << " died";
+        if (w.current_tile >= 0)
+        {
+            std::cerr << ", tile " << w.current_tile << " goes back in the queue";
+            pending.push_front(static_cast<uint32_t>(w.current_tile));
+        }
+        std::cerr << "\n";
+        close(w.fd);
+        waitpid(w.pid, nullptr, 0);
+        w.alive = false;
+        w.current_tile = -1;
+    };
+
+    auto assign = [&](worker_process& w) {
+        if (pending.empty())
+            return;
+        uint32_t tile_idx = pending.front();
+        pending.pop_front();
+        w.current_tile = tile_idx;
+        w.tile_start = clock::now();
+        if (!write_all(w.fd, &tile_idx, sizeof(tile_idx)))
+            retire(w);
+    };
+
+    // for when the workers can't be relied on any more
+    auto render_pending_here = [&] {
+        for (uint32_t tile_idx : pending)
+            add_tile(accum, tiles[tile_idx], render_tile(settings, cam, world, tiles[tile_idx]), settings.samples_per_pixel);
+        tiles_done += pending.size();
+        pending.clear();
+    };
+
+    auto start = clock::now();
+    for (worker_process& w : workers)
+        if (w.alive)
+            assign(w);
+
+    while (tiles_done < tiles.size())
+    {
+        vector<pollfd> fds;
+        vector<worker_process*> polled;
+        for (worker_process& w : workers)
+        {
+            if (!w.alive)
+                continue;
+            if (w.current_tile < 0)
+                assign(w);
+            if (w.alive && w.current_tile >= 0)
+            {
+                fds.push_back({ w.fd, POLLIN, 0 });
+                polled.push_back(&w);
+            }
+        }
+
+        if (fds.empty())
+        {
+            std::cerr << "\nNo workers left, rendering the remaining " << pending.size() << " tiles here\n";
+            render_pending_here();
+            break;
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // Polling again would only fail again. The workers' tiles are taken back and everything left is
+            // rendered here; the workers are told to quit as usual below, and one still busy finds the socket
+            // closed when it replies.
+            std::cerr << "\nCan't wait for workers (" << std::strerror(errno) << ")";
+            for (worker_process* w : polled)
+            {
+                pending.push_front(static_cast<uint32_t>(w->current_tile));
+                w->current_tile = -1;
+            }
+            std::cerr << ", rendering the remaining " << pending.size() << " tiles here\n";
+            render_pending_here();
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (fds[i].revents == 0)
+                continue;
+
+            worker_process& w = *polled[i];
+            const tile& t = tiles[w.current_tile];
+            uint32_t tile_idx;
+            vector<float> sums(size_t(t.width()) * t.height() * PIXEL_COMP_COUNT);
+            if (!read_all(w.fd, &tile_idx, sizeof(tile_idx)) || int64_t(tile_idx) != w.current_tile
+                || !read_all(w.fd, sums.data(), sums.size() * sizeof(float)))
+            {
+                retire(w);
+                continue;
+            }
+
+            add_tile(accum, t, sums, settings.samples_per_pixel);
+            w.tiles_done++;
+            w.samples += uint64_t(t.width()) * t.height() * settings.samples_per_pixel;
+            w.busy_seconds += std::chrono::duration<double>(clock::now() - w.tile_start).count();
+            w.current_tile = -1;
+
+            tiles_done++;
+            std::cerr << "\rTiles remaining: " << tiles.size() - tiles_done << ' ' << std::flush;
+        }
+    }
+
+    double wall_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    for (worker_process& w : workers)
+    {
+        if (!w.alive)
+            continue;
+        uint32_t quit = WORKER_QUIT;
+        write_all(w.fd, &quit, sizeof(quit));
+        close(w.fd);
+        waitpid(w.pid, nullptr, 0);
+    }
+
+    // throughput per worker is over the time it spent on tiles, so it doesn't count waiting for the coordinator
+    std::cerr << "\n    worker   tiles      samples  Msamples/s\n";
+    for (const worker_process& w : workers)
+    {
+        if (w.pid < 0)
+            continue;
+        std::cerr << std::setw(10) << w.pid << std::setw(8) << w.tiles_done << std::setw(13) << w.samples << std::setw(12)
+                  << std::fixed << std::setprecision(3) << (w.busy_seconds > 0 ? w.samples / w.busy_seconds / 1e6 : 0.0)
+                  << std::defaultfloat << (w.alive ? "" : "  (died)") << "\n";
+    }
+    uint64_t total_samples = uint64_t(settings.samples_per_pixel) * settings.pixel_count();
+    std::cerr << "Total: " << total_samples / wall_seconds / 1e6 << " Msamples/s over " << wall_seconds << " s\n";
+
+    return accum;
+}
+
+#endif // RT_DISTRIBUTED_POSIX
+#endif // RT_DISTRIBUTED
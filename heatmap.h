@@ -0,0 +1,57 @@
+#ifndef RT_HEATMAP
+#define RT_HEATMAP
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+using std::vector;
+
+// Inferno-like color ramp from black (cheap) through purple and orange to pale yellow (expensive), t in [0, 1].
+// Brightness rises steadily along it, so it still reads correctly in grayscale.
+inline color heat_color(double t)
+{
+    static const color stops[] = {
+        color(0.00, 0.00, 0.02),
+        color(0.34, 0.06, 0.43),
+        color(0.73, 0.21, 0.33),
+        color(0.98, 0.55, 0.04),
+        color(0.99, 1.00, 0.64),
+    };
+    const int last = sizeof(stops) / sizeof(stops[0]) - 1;
+
+    t = clamp(t, 0.0, 1.0) * last;
+    int i = std::min(static_cast<int>(t), last - 1);
+    double f = t - i;
+    return (1 - f) * stops[i] + f * stops[i + 1];
+}
+
+// Writes the render time of every pixel (nanoseconds, row-major from the bottom row like the renderer) as a
+// false-color PNG, and prints a summary. Colors are scaled to the 99th percentile, so a few outliers don't
+// leave the rest of the image dark; anything above it is drawn in the top color.
+inline bool write_heatmap(const std::string& path, const vector<double>& pixel_ns, uint32_t width, uint32_t height)
+{
+    vector<double> sorted = pixel_ns;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double ns : sorted)
+        total += ns;
+    double p99 = sorted[sorted.size() * 99 / 100];
+    double scale = p99 > 0 ? 1.0 / p99 : 0.0;
+
+    std::cerr << "Pixel cost: mean " << total / sorted.size() / 1000.0 << " us, median " << sorted[sorted.size() / 2] / 1000.0
+              << " us, 99th percentile " << p99 / 1000.0 << " us, max " << sorted.back() / 1000.0 << " us\n";
+
+    image_buffer img(width, height);
+    for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+            img.set_pixel(x, y, heat_color(pixel_ns[size_t(y) * width + x] * scale));
+
+    return write_png(path, img);
+}
+
+#endif // RT_HEATMAP
@@ -1,27 +1,122 @@
 #ifndef RT_HITTABLE
 #define RT_HITTABLE
 
+#include <cstdint>
+
 #include "ray.h"
+#include "aabb.h"
+#include "stats.h"
 
 struct material;
 
-struct hit_record
+template <typename T>
+struct hit_record_t
 {
-    point3 point;
-    vec3 normal;
-    shared_ptr<material> material;
-    float time;
+    vec3_t<T> point;
+    vec3_t<T> normal;
+    const material* mat; // owned by the scene, see scene::materials
+    T time;
     bool front_face;
     
-    inline void set_face_normal(const ray& r, const vec3& outward_normal) {
+    inline void set_face_normal(const ray_t<T>& r, const vec3_t<T>& outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal :-outward_normal;
     }
 };
 
+using hit_record = hit_record_t<real>;
+
+// most rays in a ray_packet, a bit mask of them fits in a uint32_t
+const uint32_t RAY_PACKET_MAX = 16;
+
+// Rays intersected with the world together (see hittable::hit_packet), e.g. the camera rays of a block of
+// neighboring pixels. Such rays mostly visit the same nodes, so a packet fetches and tests each node once for all
+// of them, and intersects several rays with each SIMD instruction at the leaves. The rays are also kept
+// structure-of-arrays for those loops.
+struct ray_packet
+{
+    uint32_t size = 0;
+    real t_min = 0;
+    ray rays[RAY_PACKET_MAX];
+
+    alignas(32) real org[3][RAY_PACKET_MAX];
+    alignas(32) real dir[3][RAY_PACKET_MAX];
+    alignas(32) real dir_length_squared[RAY_PACKET_MAX];
+    // for the float box tests: the origin rounded down and up, and the inverse direction
+    alignas(32) float org_lo_f[3][RAY_PACKET_MAX];
+    alignas(32) float org_hi_f[3][RAY_PACKET_MAX];
+    alignas(32) float inv_dir_f[3][RAY_PACKET_MAX];
+
+    // Results: each ray's nearest hit so far is in rec, at t_max, if its bit in hit_mask is set. Unused lanes
+    // past size are zero rays with t_max = -infinity, so they never hit anything.
+    alignas(32) real t_max[RAY_PACKET_MAX];
+    hit_record rec[RAY_PACKET_MAX];
+    uint32_t hit_mask = 0;
+
+    // empties the packet; rays added next are intersected in [_t_min, _t_max]
+    void reset(real _t_min, real _t_max)
+    {
+        size = 0;
+        t_min = _t_min;
+        hit_mask = 0;
+        for (uint32_t i = 0; i < RAY_PACKET_MAX; i++)
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                org[a][i] = dir[a][i] = 0;
+                org_lo_f[a][i] = org_hi_f[a][i] = inv_dir_f[a][i] = 0;
+            }
+            dir_length_squared[i] = 0;
+            t_max[i] = -INF;
+        }
+        added_t_max = _t_max;
+    }
+
+    // returns the ray's lane
+    uint32_t add(const ray& r)
+    {
+        uint32_t i = size++;
+        rays[i] = r;
+        point3 o = r.origin();
+        vec3 d = r.direction();
+        for (int a = 0; a < 3; a++)
+        {
+            org[a][i] = o[a];
+            dir[a][i] = d[a];
+            org_lo_f[a][i] = float_below(o[a]);
+            org_hi_f[a][i] = float_above(o[a]);
+            inv_dir_f[a][i] = static_cast<float>(1.0 / d[a]);
+        }
+        dir_length_squared[i] = d.length_squared();
+        t_max[i] = added_t_max;
+        return i;
+    }
+
+    // bit mask of the rays in the packet
+    uint32_t all() const { return (1u << size) - 1; }
+
+private:
+    real added_t_max = INF;
+};
+
 struct hittable
 {
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+    // Intersects each ray of the packet as hit() would, leaving the results in it. This default traces them one
+    // at a time; structures that can do better with coherent rays override it.
+    virtual void hit_packet(ray_packet& packet) const
+    {
+        for (uint32_t i = 0; i < packet.size; i++)
+        {
+            if (hit(packet.rays[i], packet.t_min, packet.t_max[i], packet.rec[i]))
+            {
+                packet.t_max[i] = packet.rec[i].time;
+                packet.hit_mask |= 1u << i;
+            }
+        }
+    }
+    // returns false if the object has no finite bounds (and so can't be put in a bvh_node)
+    virtual bool bounding_box(aabb& output_box) const = 0;
 };
 
 #endif // RT_HITTABLE
\ No newline at end of file
@@ -28,15 +28,18 @@ public:
         objs.push_back(obj);
     }
 
-    virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+    const vector<shared_ptr<hittable>>& objects() const { return objs; }
+
+    virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+    virtual bool bounding_box(aabb& output_box) const override;
 };
 
-bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const 
+bool hittable_list::hit(const ray& r, real t_min, real t_max, hit_record& rec) const 
 {
     hit_record temp;
 
     bool hit = false;
-    double closest = t_max;
+    real closest = t_max;
 
     for (const auto& obj : objs )
     {
@@ -51,4 +54,23 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
     return hit;
 }
 
+bool hittable_list::bounding_box(aabb& output_box) const
+{
+    if (objs.empty())
+        return false;
+
+    aabb temp_box;
+    bool first_box = true;
+
+    for (const auto& obj : objs)
+    {
+        if (!obj->bounding_box(temp_box))
+            return false;
+        output_box = first_box ? temp_box : surrounding_box(output_box, temp_box);
+        first_box = false;
+    }
+
+    return true;
+}
+
 #endif // RT_HITTABLE_LIST
\ No newline at end of file
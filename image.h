@@ -1,15 +1,119 @@
 #ifndef RT_COLOR
 #define RT_COLOR
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include "stb_image_write.h"
 
 #include "vec3.h"
 #include "rt.h"
+#include "trace.h"
 
 // individual size of each component in a pixel (R, G, B)
 using pixel_comp = uint8_t;
 const uint8_t PIXEL_COMP_COUNT = 3; // RGB
-const uint32_t SAMPLES_PER_PIXEL = 100;
+
+using std::vector;
+
+// Linear radiance accumulated over a render: the float RGB sum of each pixel's samples and how many there are.
+// Nothing is quantized, so a render can keep taking samples, be merged with another render of the same frame,
+// or be saved losslessly and tonemapped later. Rows are stored bottom row first, as the renderer numbers them.
+struct hdr_buffer
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    vector<float> radiance; // PIXEL_COMP_COUNT sums per pixel
+    vector<uint32_t> samples;
+
+    hdr_buffer() {}
+    hdr_buffer(uint32_t _width, uint32_t _height)
+        : width(_width), height(_height), radiance(size_t(_width) * _height * PIXEL_COMP_COUNT, 0.0f),
+          samples(size_t(_width) * _height, 0)
+    {
+    }
+
+    size_t pixel_count() const { return samples.size(); }
+
+    // adds count samples summing to sum to a pixel
+    void add(size_t pixel, const color& sum, uint32_t count)
+    {
+        radiance[pixel * PIXEL_COMP_COUNT] += static_cast<float>(sum.r());
+        radiance[pixel * PIXEL_COMP_COUNT + 1] += static_cast<float>(sum.g());
+        radiance[pixel * PIXEL_COMP_COUNT + 2] += static_cast<float>(sum.b());
+        samples[pixel] += count;
+    }
+
+    color sum(size_t pixel) const
+    {
+        return color(radiance[pixel * PIXEL_COMP_COUNT], radiance[pixel * PIXEL_COMP_COUNT + 1], radiance[pixel * PIXEL_COMP_COUNT + 2]);
+    }
+
+    color average(size_t pixel) const
+    {
+        return samples[pixel] > 0 ? sum(pixel) / samples[pixel] : color(0, 0, 0);
+    }
+
+    // Adds the samples of another render of the same frame. Only meaningful if the two used different seeds,
+    // otherwise they took the same samples.
+    void merge(const hdr_buffer& other)
+    {
+        for (size_t i = 0; i < radiance.size(); i++)
+            radiance[i] += other.radiance[i];
+        for (size_t i = 0; i < samples.size(); i++)
+            samples[i] += other.samples[i];
+    }
+};
+
+// Writes the average radiance of every pixel as a little-endian Portable Float Map (PFM), which is just a
+// short text header and raw float RGB rows from the bottom up. Sample counts aren't part of the format.
+inline bool write_pfm(const std::string& path, const hdr_buffer& hdr)
+{
+    trace_scope trace("encode pfm");
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    // a negative scale marks the data as little-endian
+    file << "PF\n" << hdr.width << " " << hdr.height << "\n-1.0\n";
+
+    vector<float> row(size_t(hdr.width) * PIXEL_COMP_COUNT);
+    for (uint32_t y = 0; y < hdr.height; y++)
+    {
+        for (uint32_t x = 0; x < hdr.width; x++)
+        {
+            color c = hdr.average(size_t(y) * hdr.width + x);
+            for (int comp = 0; comp < PIXEL_COMP_COUNT; comp++)
+                row[x * PIXEL_COMP_COUNT + comp] = static_cast<float>(c[comp]);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+
+    return bool(file);
+}
+
+// Reads an RGB PFM written by write_pfm (or any little-endian one) as one sample per pixel.
+inline bool read_pfm(const std::string& path, hdr_buffer& hdr)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    uint32_t width = 0, height = 0;
+    double scale = 0;
+    if (!(file >> magic >> width >> height >> scale) || magic != "PF" || scale >= 0 || width == 0 || height == 0)
+        return false;
+    file.get(); // the single whitespace character ending the header
+
+    hdr = hdr_buffer(width, height);
+    file.read(reinterpret_cast<char*>(hdr.radiance.data()), hdr.radiance.size() * sizeof(float));
+    std::fill(hdr.samples.begin(), hdr.samples.end(), 1);
+    return bool(file);
+}
 
 struct image_buffer
 {
@@ -27,19 +131,79 @@ struct image_buffer
         buf = new pixel_comp[buf_size];
     }
 
-    void write_color( uint32_t x, uint32_t y, color col )
+    ~image_buffer() { delete[] buf; }
+
+    image_buffer(const image_buffer&) = delete;
+    image_buffer& operator=(const image_buffer&) = delete;
+
+    // col is the sum of the pixel's samples
+    void write_color( uint32_t x, uint32_t y, color col, uint32_t samples )
     {
         // gamma correction of 2 involves the power of 1/gamma or 1/2, so we can just sqrt
-        auto scale = 1.0 / SAMPLES_PER_PIXEL;
+        auto scale = samples > 0 ? 1.0 / samples : 0.0;
         auto r = sqrt(col.r() * scale);
         auto g = sqrt(col.g() * scale);
         auto b = sqrt(col.b() * scale);
 
+        set_pixel(x, y, color(r, g, b));
+    }
+
+    // stores an already display-ready color in [0, 1], y = 0 being the bottom row
+    void set_pixel( uint32_t x, uint32_t y, color col )
+    {
         uint32_t idx = ((image_height - 1 - y) * image_width + x);
-        buf[idx * PIXEL_COMP_COUNT] = static_cast<pixel_comp>(255 * clamp(r, 0.0, 0.999));
-        buf[idx * PIXEL_COMP_COUNT + 1] = static_cast<pixel_comp>(255 * clamp(g, 0.0, 0.999));
-        buf[idx * PIXEL_COMP_COUNT + 2] = static_cast<pixel_comp>(255 * clamp(b, 0.0, 0.999));
+        buf[idx * PIXEL_COMP_COUNT] = static_cast<pixel_comp>(255 * clamp(col.r(), 0.0, 0.999));
+        buf[idx * PIXEL_COMP_COUNT + 1] = static_cast<pixel_comp>(255 * clamp(col.g(), 0.0, 0.999));
+        buf[idx * PIXEL_COMP_COUNT + 2] = static_cast<pixel_comp>(255 * clamp(col.b(), 0.0, 0.999));
+    }
+
+    // Tonemaps the accumulated radiance into the 8-bit image. Kept separate from rendering so the same
+    // hdr_buffer can be re-exported, e.g. after more samples or once read back from a PFM.
+    void write_hdr( const hdr_buffer& hdr )
+    {
+        for (uint32_t y = 0; y < image_height; y++)
+            for (uint32_t x = 0; x < image_width; x++)
+            {
+                size_t pixel = size_t(y) * image_width + x;
+                write_color(x, y, hdr.sum(pixel), hdr.samples[pixel]);
+            }
     }
 };
 
+// Moves the file at from to path, replacing any file already there. std::rename can't be used for this: on
+// Windows it fails when the target exists.
+inline bool replace_file(const std::string& from, const std::string& path)
+{
+    std::error_code error;
+    std::filesystem::rename(from, path, error);
+    return !error;
+}
+
+// Saves img as a PNG. The file is written under a temporary name and then renamed over path, so anything
+// watching path never sees a half-written image.
+inline bool write_png(const std::string& path, const image_buffer& img)
+{
+    trace_scope trace("encode png");
+    std::string temp_path = path + ".tmp";
+    if (!stbi_write_png(temp_path.c_str(), img.image_width, img.image_height, PIXEL_COMP_COUNT, img.buf, img.image_width * PIXEL_COMP_COUNT * sizeof(img.buf[0]))
+        || !replace_file(temp_path, path))
+    {
+        std::cerr << "Can't write '" << path << "'\n";
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// tonemaps hdr into an 8-bit image and saves it as a PNG
+inline bool write_png(const std::string& path, const hdr_buffer& hdr)
+{
+    image_buffer img(hdr.width, hdr.height);
+    {
+        trace_scope trace("tonemap");
+        img.write_hdr(hdr);
+    }
+    return write_png(path, img);
+}
+
 #endif // RT_COLOR
\ No newline at end of file
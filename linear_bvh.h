@@ -0,0 +1,283 @@
+#ifndef RT_LINEAR_BVH
+#define RT_LINEAR_BVH
+
+#include <chrono>
+#include <future>
+#include <cstdint>
+
+#include "bvh.h"
+
+// Deepest path a linear_bvh can have, and so the size of its traversal stack. The builder switches to median
+// splits (which halve the object count every level) once half of this depth is used up, so it can't be exceeded.
+const int LINEAR_BVH_MAX_DEPTH = 64;
+// most objects a SAH leaf may hold, when intersecting them all is cheaper than splitting further
+const uint16_t LINEAR_BVH_MAX_LEAF_SIZE = 4;
+
+// One node of a linear_bvh, sized and aligned so that two nodes exactly fill a 64-byte cache line.
+// Bounds are stored as floats rounded outwards, so they always contain the exact double precision bounds.
+struct alignas(32) linear_bvh_node
+{
+    float bounds[2][3]; // [0] = min corner, [1] = max corner
+    // leaf: index of its first primitive; interior: index of the second child (the first child is the next node)
+    uint32_t offset;
+    uint16_t count; // primitives in a leaf, 0 for interior nodes
+    uint8_t axis;   // interior: axis the children were split along, to visit the nearer child first
+    uint8_t pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should be 32 bytes");
+
+// Leaf storage for the flattened BVHs: holds the primitives in leaf order and intersects a leaf's run of them.
+// This is the general version, primitives stored by value; see sphere_soa for a SIMD one for spheres.
+template <typename primitive>
+struct primitive_array
+{
+    vector<primitive> items;
+
+    size_t size() const { return items.size(); }
+    void reserve(size_t count) { items.reserve(count); }
+    void push_back(const primitive& obj) { items.push_back(obj); }
+    void append(const primitive_array& other) { items.insert(items.end(), other.items.begin(), other.items.end()); }
+
+    // intersects items [first, first + count), keeping the nearest hit and narrowing t_max to it
+    bool hit(uint32_t first, uint32_t count, const ray& r, real t_min, real& t_max, hit_record& rec) const
+    {
+        bool hit_anything = false;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            // qualified call: statically dispatched, items holds exactly primitive objects
+            if (items[i].primitive::hit(r, t_min, t_max, rec))
+            {
+                hit_anything = true;
+                t_max = rec.time;
+            }
+        }
+        return hit_anything;
+    }
+
+    // Same for each ray of the packet in the bit mask rays, keeping the nearest hits in the packet. Nothing is
+    // shared between rays here, so they are simply intersected one at a time.
+    void hit_packet(uint32_t first, uint32_t count, ray_packet& packet, uint32_t rays) const
+    {
+        for (uint32_t i = 0; i < packet.size; i++)
+        {
+            if ((rays & (1u << i)) && hit(first, count, packet.rays[i], packet.t_min, packet.t_max[i], packet.rec[i]))
+                packet.hit_mask |= 1u << i;
+        }
+    }
+};
+
+// BVH compiled into a flat depth-first array of nodes, with the primitives copied into leaf order so each leaf's
+// primitives are contiguous. primitive is a concrete hittable type (e.g. sphere): primitives are stored by value
+// and intersected with a non-virtual call, so the traversal loop has no pointer chasing or virtual dispatch.
+// storage holds the primitives, see primitive_array for the interface it needs.
+template <typename primitive, typename storage = primitive_array<primitive>>
+struct linear_bvh : public hittable
+{
+    vector<linear_bvh_node> nodes;
+    storage prims;
+
+    linear_bvh() {}
+    // stats, if given, receives the node count, expected SAH cost and build time of the tree
+    linear_bvh(const vector<primitive>& objects, bvh_split_method method = bvh_split_method::sah, bvh_build_stats* stats = nullptr);
+
+    bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override;
+    bool bounding_box(aabb& output_box) const override;
+
+private:
+    double build(const vector<primitive>& objects, vector<bvh_primitive>& refs, size_t start, size_t end,
+                 bvh_split_method method, int depth);
+    // appends a separately built tree's nodes and primitives, rebasing its offsets
+    void append_subtree(const linear_bvh& subtree);
+};
+
+inline void set_node_bounds(linear_bvh_node& node, const aabb& box)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        node.bounds[0][a] = std::nextafter(static_cast<float>(box.min()[a]), -std::numeric_limits<float>::infinity());
+        node.bounds[1][a] = std::nextafter(static_cast<float>(box.max()[a]), std::numeric_limits<float>::infinity());
+    }
+}
+
+template <typename primitive, typename storage>
+linear_bvh<primitive, storage>::linear_bvh(const vector<primitive>& objects, bvh_split_method method, bvh_build_stats* stats)
+{
+    if (objects.empty())
+        return;
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    vector<bvh_primitive> refs = make_bvh_primitives(objects.size(), [&](size_t i, aabb& box) {
+        return objects[i].bounding_box(box);
+    });
+
+    nodes.reserve(2 * objects.size());
+    prims.reserve(objects.size());
+    double cost = build(objects, refs, 0, refs.size(), method, 0);
+
+    if (stats)
+    {
+        double root_area = surface_area(primitive_bounds(refs, 0, refs.size()));
+        stats->node_count = nodes.size();
+        stats->object_count = objects.size();
+        stats->sah_cost = root_area > 0 ? cost / root_area : 0;
+        stats->build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+}
+
+template <typename primitive, typename storage>
+double linear_bvh<primitive, storage>::build(const vector<primitive>& objects, vector<bvh_primitive>& refs, size_t start, size_t end,
+                                    bvh_split_method method, int depth)
+{
+    size_t node_idx = nodes.size();
+    nodes.emplace_back();
+
+    aabb box = primitive_bounds(refs, start, end);
+    double area = surface_area(box);
+    set_node_bounds(nodes[node_idx], box);
+
+    size_t span = end - start;
+    size_t mid = start;
+    bool make_leaf = span == 1;
+
+    if (!make_leaf)
+    {
+        // past half the depth budget, median splits guarantee the rest of the tree fits in the traversal stack
+        if (depth >= LINEAR_BVH_MAX_DEPTH / 2)
+            method = bvh_split_method::median;
+        // traversal order hint: both split methods separate the children mostly along the longest centroid axis
+        nodes[node_idx].axis = static_cast<uint8_t>(centroid_bounds(refs, start, end).longest_axis());
+        mid = bvh_split(refs, start, end, method);
+
+        if (span <= LINEAR_BVH_MAX_LEAF_SIZE && method == bvh_split_method::sah)
+        {
+            double split_cost = BVH_TRAVERSAL_COST
+                + (surface_area(primitive_bounds(refs, start, mid)) * (mid - start)
+                   + surface_area(primitive_bounds(refs, mid, end)) * (end - mid)) / area * BVH_INTERSECT_COST;
+            make_leaf = span * BVH_INTERSECT_COST <= split_cost;
+        }
+    }
+
+    if (make_leaf)
+    {
+        nodes[node_idx].offset = static_cast<uint32_t>(prims.size());
+        nodes[node_idx].count = static_cast<uint16_t>(span);
+        for (size_t i = start; i < end; i++)
+            prims.push_back(objects[refs[i].index]);
+        return area * (BVH_TRAVERSAL_COST + span * BVH_INTERSECT_COST);
+    }
+
+    // A large right subtree is built into a tree of its own on another thread, then appended once the left
+    // subtree is done, which keeps the depth-first layout. The two halves only touch their own range of refs.
+    linear_bvh right_tree;
+    std::future<double> right_cost = bvh_spawn_subtree(mid, end, [&] {
+        return right_tree.build(objects, refs, mid, end, method, depth + 1);
+    });
+
+    double children_cost = build(objects, refs, start, mid, method, depth + 1);
+    nodes[node_idx].offset = static_cast<uint32_t>(nodes.size());
+    nodes[node_idx].count = 0;
+    if (right_cost.valid())
+    {
+        children_cost += right_cost.get();
+        append_subtree(right_tree);
+    }
+    else
+    {
+        children_cost += build(objects, refs, mid, end, method, depth + 1);
+    }
+
+    return area * BVH_TRAVERSAL_COST + children_cost;
+}
+
+template <typename primitive, typename storage>
+void linear_bvh<primitive, storage>::append_subtree(const linear_bvh& subtree)
+{
+    uint32_t node_base = static_cast<uint32_t>(nodes.size());
+    uint32_t prim_base = static_cast<uint32_t>(prims.size());
+
+    for (linear_bvh_node node : subtree.nodes)
+    {
+        node.offset += node.count > 0 ? prim_base : node_base;
+        nodes.push_back(node);
+    }
+    prims.append(subtree.prims);
+}
+
+template <typename primitive, typename storage>
+bool linear_bvh<primitive, storage>::hit(const ray& r, real t_min, real t_max, hit_record& rec) const
+{
+    if (nodes.empty())
+        return false;
+
+    point3 orig = r.origin();
+    vec3 dir = r.direction();
+    vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+    int dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+    uint32_t stack[LINEAR_BVH_MAX_DEPTH];
+    int stack_size = 0;
+    uint32_t node_idx = 0;
+    bool hit_anything = false;
+
+    while (true)
+    {
+        const linear_bvh_node& node = nodes[node_idx];
+        RT_STAT_INC(nodes_visited);
+
+        // slab test, with the near and far planes of each axis picked by the sign of the ray direction
+        real t0 = t_min, t1 = t_max;
+        for (int a = 0; a < 3; a++)
+        {
+            real near_t = (node.bounds[dir_is_neg[a]][a] - orig[a]) * inv_dir[a];
+            real far_t = (node.bounds[1 - dir_is_neg[a]][a] - orig[a]) * inv_dir[a];
+            t0 = near_t > t0 ? near_t : t0;
+            t1 = far_t < t1 ? far_t : t1;
+        }
+
+        if (t0 <= t1)
+        {
+            if (node.count > 0)
+            {
+                if (prims.hit(node.offset, node.count, r, t_min, t_max, rec))
+                    hit_anything = true;
+            }
+            else
+            {
+                // descend into the child nearer to the ray origin first, so t_max shrinks sooner
+                if (dir_is_neg[node.axis])
+                {
+                    stack[stack_size++] = node_idx + 1;
+                    node_idx = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    node_idx = node_idx + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        node_idx = stack[--stack_size];
+    }
+
+    return hit_anything;
+}
+
+template <typename primitive, typename storage>
+bool linear_bvh<primitive, storage>::bounding_box(aabb& output_box) const
+{
+    if (nodes.empty())
+        return false;
+
+    const linear_bvh_node& root = nodes[0];
+    output_box = aabb(point3(root.bounds[0][0], root.bounds[0][1], root.bounds[0][2]),
+                      point3(root.bounds[1][0], root.bounds[1][1], root.bounds[1][2]));
+    return true;
+}
+
+#endif // RT_LINEAR_BVH
@@ -2,11 +2,11 @@
 #include <string>
 #include <sstream>
 #include <cstdint>
+#include <chrono>
+#include <memory>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
 
 #include "vec3.h"
 #include "image.h"
@@ -14,84 +14,140 @@
 #include "ray.h"
 #include "sphere.h"
 #include "hittable_list.h"
+#include "accel.h"
+#include "sphere_soa.h"
 #include "camera.h"
 #include "material.h"
+#include "scene.h"
+#include "settings.h"
+#include "renderer.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "distributed.h"
+#include "heatmap.h"
+#include "trace.h"
+
+// after the headers that use it, whose includes only declare its functions
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
-color ray_color(const ray& r, const hittable_list &world, int depth) {
-    hit_record rec;
-
-    if (depth <= 0)
-        return color(0,0,0);
+int main(int argc, char** argv)
+{
+    render_settings settings;
+    if (!parse_settings(argc, argv, settings))
+        return 1;
+    trace_enabled = !settings.trace.empty();
 
-    // t_min = 0.001 so rays don't collide with surface they were just reflected off of (called shadow acne)
-    if( world.hit(r, 0.001, INF, rec ) )
+    if (!settings.tonemap_input.empty())
     {
-        ray scattered;
-        color attenuation;
-        if (rec.material->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth-1); 
+        hdr_buffer hdr;
+        if (!read_pfm(settings.tonemap_input, hdr))
+        {
+            std::cerr << "Can't read PFM '" << settings.tonemap_input << "'\n";
+            return 1;
+        }
+        return write_png(settings.output, hdr) ? 0 : 1;
+    }
 
-        return color(0,0,0);
+    uint32_t width = settings.image_width;
+    uint32_t height = settings.image_height();
 
-        // using random_unit_vector over random_in_unit_sphere results in more uniform scattering of light rays (fewer rays scattering toward the normal)
-        // point3 target = rec.point + rec.normal + random_unit_vector();
+    scene world;
+    {
+        trace_scope trace("scene build");
+        if (!make_scene(settings.scene, settings.scene_size, world))
+            return 1;
+    }
 
-        // alternative diffuse method that doesn't offset by surface's normal, about equivalent but has minor differences 
-        // point3 target = rec.point + random_in_hemisphere(rec.normal);
+    bvh_build_stats bvh_stats;
+    shared_ptr<hittable> world_accel;
+    {
+        trace_scope trace("bvh build");
+        world_accel = build_accel<sphere, sphere_soa>(world.spheres, settings.accel, settings.bvh_split, &bvh_stats);
+    }
+    std::cerr << accel_type_name(settings.accel) << ": " << bvh_stats.object_count << " objects, " << bvh_stats.node_count << " nodes, SAH cost "
+              << bvh_stats.sah_cost << ", built in " << bvh_stats.build_seconds * 1000.0 << " ms\n";
+
+    camera cam = world.view.make_camera(settings.aspect_ratio);
 
-        // -1 to 1 -> 0 to 1
-        // return 0.5 * ray_color(ray(rec.point, target - rec.point), world, depth-1);
+    hdr_buffer image;
+    if (settings.workers > 0)
+    {
+#ifdef RT_DISTRIBUTED_POSIX
+        if (settings.adaptive || settings.progressive || !settings.checkpoint.empty() || !settings.heatmap.empty() ||
+            settings.packet_size > 1)
+        {
+            std::cerr << "workers only render uniformly, one ray at a time: no adaptive, progressive, checkpoint, heatmap or packet_size\n";
+            return 1;
+        }
+        std::cerr << "Rendering " << width << "x" << height << " on " << settings.workers << " worker processes\n";
+        image = render_distributed(settings, cam, *world_accel);
+#else
+        std::cerr << "workers aren't supported on this platform\n";
+        return 1;
+#endif
     }
+    else
+    {
+        renderer render(settings, cam, *world_accel);
+        std::cerr << "Rendering " << width << "x" << height << " in " << render.tiles.size() << " tiles on " << render.pool.size() << " threads\n";
 
-    vec3 dir = unit_vector(r.direction());
-    double t = 0.5 * (dir.y() + 1.0);
-    // lerp
-    return (1.0 - t) * color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
-}
+        if (settings.resume)
+        {
+            if (settings.checkpoint.empty())
+            {
+                std::cerr << "resume needs a checkpoint file\n";
+                return 1;
+            }
+            if (!read_checkpoint(settings.checkpoint, render))
+                return 1;
+            std::cerr << "Resuming from " << render.samples_taken << " samples\n";
+        }
 
-int main()
-{
-    image_buffer img(IMAGE_WIDTH, IMAGE_HEIGHT);
+        std::unique_ptr<snapshot_writer> snapshots;
+        if (settings.progressive)
+            snapshots = std::make_unique<snapshot_writer>(settings.output, settings.snapshot_interval);
 
-    hittable_list world;
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        render.on_pass = [&](const renderer& r) {
+            if (snapshots)
+                snapshots->publish(r.accum);
 
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left   = make_shared<dielectric>(1.5);
-    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
+            auto now = std::chrono::steady_clock::now();
+            if (!settings.checkpoint.empty() && std::chrono::duration<double>(now - last_checkpoint).count() >= settings.checkpoint_interval)
+            {
+                write_checkpoint(settings.checkpoint, r);
+                last_checkpoint = now;
+            }
+        };
+        render_timer timer;
+        render.render();
+        std::cerr << "\n";
+        print_render_report(timer, render.pool.size());
 
-    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0),   0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0,    0.0, -1.0), -0.45, material_left));
-    world.add(make_shared<sphere>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+        if (!settings.heatmap.empty() && !write_heatmap(settings.heatmap, render.pixel_ns, width, height))
+            return 1;
 
-    point3 from(3,3,2);
-    point3 to(0,0,-1);
-    camera cam(from, to, vec3(0,1,0), 20, 2.0, (to-from).length());
+        image = std::move(render.accum);
+    }
 
-    for( int y = IMAGE_HEIGHT - 1; y >= 0; y--)
+    if (!settings.hdr_output.empty())
     {
-        std::cerr << "\rScanlines remaining: " << y << ' ' << std::flush;
-        for( int x = 0; x < IMAGE_WIDTH; x++)
+        std::cerr << "\nWriting PFM...\n";
+        if (!write_pfm(settings.hdr_output, image))
         {
-            color final_col(0, 0, 0);
-            for (int s = 0; s < SAMPLES_PER_PIXEL; s++)
-            {
-                double u = (double(x) + random_double()) / (IMAGE_WIDTH - 1);
-                double v = (double(y) + random_double()) / (IMAGE_HEIGHT - 1);
-                ray ray = cam.get_ray(u, v);
-
-                final_col += ray_color(ray, world, MAX_DEPTH);
-            }
-
-            img.write_color(x, y, final_col);
+            std::cerr << "Can't write '" << settings.hdr_output << "'\n";
+            return 1;
         }
     }
 
     std::cerr << "\nWriting PNG...\n";
+    if (!write_png(settings.output, image))
+        return 1;
 
-    stbi_write_png("image.png", IMAGE_WIDTH, IMAGE_HEIGHT, STBI_rgb, img.buf, IMAGE_WIDTH * 3 * sizeof(img.buf[0]));
+    // every thread that recorded events is idle or gone by now
+    if (!settings.trace.empty() && !write_trace(settings.trace))
+        return 1;
 
     std::cerr << "\nDone.\n";
 }
\ No newline at end of file
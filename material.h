@@ -7,7 +7,7 @@
 
 struct material
 {
-    virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const = 0;
+    virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen) const = 0;
 };
 
 // lambertian diffuse material, can either scatter always and attenuate by reflectance R or it can scatter w/ no attenuation but absorb 1 - R of the rays (or a mix of those two approaches)
@@ -17,9 +17,10 @@ struct lambertian : public material
     
     lambertian(const color& a) : albedo(a) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override 
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen) const override 
     {
-        vec3 scatter_dir = rec.normal + random_unit_vector();
+        RT_STAT_INC(scatters[STAT_LAMBERTIAN]);
+        vec3 scatter_dir = rec.normal + random_unit_vector(gen);
     
         // check done in order to avoid NaNs and infinity mischief when summing two random unit vectors that could be potentially be opposites (summing to 0, so it has a zero scatter direction vector)
         if (scatter_dir.near_zero())
@@ -39,10 +40,11 @@ struct metal : public material
 
     metal(const color& a, float f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override 
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen) const override 
     {
+        RT_STAT_INC(scatters[STAT_METAL]);
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.point, reflected + fuzz*random_in_unit_sphere());
+        scattered = ray(rec.point, reflected + fuzz*random_in_unit_sphere(gen));
         attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
@@ -61,8 +63,9 @@ struct dielectric : public material
         return r0 + (1-r0)*pow((1 - cosine),5);
     }
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override 
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen) const override 
     {
+        RT_STAT_INC(scatters[STAT_DIELECTRIC]);
         attenuation = color(1.0, 1.0, 1.0);
         double refract_ratio = rec.front_face ? (1.0 / ir) : ir;
         
@@ -76,7 +79,7 @@ struct dielectric : public material
         bool total_internal_reflection = refract_ratio * sin_theta > 1.0;
         vec3 refract_dir;
         // Reflectivity varies w/ angle (i.e. looking at a window at a steep angle makes it a mirror). There is a formal, complex equation to simulate that, however "everybody" uses Schlick's Approximation to get a suprisingly accurate polynomial approximation of it 
-        if (total_internal_reflection || reflectance(cos_theta, refract_ratio) > random_double())
+        if (total_internal_reflection || reflectance(cos_theta, refract_ratio) > random_double(gen))
             refract_dir = reflect(unit_dir, rec.normal);
         else
             refract_dir = refract(unit_dir, rec.normal, refract_ratio);
@@ -0,0 +1,254 @@
+// Microbenchmarks of the kernels a path spends its time in, in nanoseconds per call, to measure SIMD and layout
+// changes without the noise of a whole render. Inputs are taken from the default scene (camera rays and the
+// hits they produce) so branches go the way they do in a render; the primary16_ kernels trace blocks of camera
+// rays into the random scene, which has a tree worth traversing. Prints CSV to stdout.
+//
+// Usage: microbench [--reps N] [--calls N] [--only KERNEL]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "rt.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "ray.h"
+#include "sphere.h"
+#include "material.h"
+#include "camera.h"
+#include "scene.h"
+#include "accel.h"
+#include "sphere_soa.h"
+#include "settings.h"
+
+using std::vector;
+
+// distinct inputs cycled through by each benchmark, a power of two so the index is a mask
+const size_t MICROBENCH_INPUTS = 4096;
+
+// Results are folded into this so the compiler can't drop the calls being timed.
+volatile double microbench_sink;
+
+struct microbench_result
+{
+    double median_ns;
+    double min_ns;
+};
+
+// Times calls calls of kernel(i), reps times, and returns the per-call time of the median and fastest rep.
+// kernel returns a value derived from its result, which is accumulated into the sink. It is a template
+// parameter rather than a std::function so the call is inlined and only the kernel itself is timed.
+template <typename F>
+microbench_result time_kernel(F kernel, int reps, size_t calls)
+{
+    vector<double> ns;
+    for (int rep = 0; rep < reps; rep++)
+    {
+        double sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; i++)
+            sum += kernel(i & (MICROBENCH_INPUTS - 1));
+        auto end = std::chrono::steady_clock::now();
+        microbench_sink = sum;
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / calls);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    return { ns[ns.size() / 2], ns[0] };
+}
+
+int main(int argc, char** argv)
+{
+    int reps = 7;
+    size_t calls = 1 << 22;
+    std::string only;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        bool ok = true;
+        if (key == "--reps")
+            ok = parse_count(value, reps) && reps > 0;
+        else if (key == "--calls")
+            ok = parse_count(value, calls) && calls > 0;
+        else if (key == "--only")
+            only = value;
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--reps N] [--calls N] [--only KERNEL]\n";
+            return 1;
+        }
+    }
+
+    // inputs: camera rays through random pixels of the default scene, and where they first hit it
+    scene world = default_scene();
+    camera cam = world.view.make_camera(16.0 / 9.0);
+    shared_ptr<hittable> world_accel = build_accel<sphere, sphere_soa>(world.spheres, accel_type::bvh4, bvh_split_method::sah);
+
+    rng gen(1);
+    vector<double> screen_s, screen_t;
+    vector<ray> rays;
+    vector<hit_record> hits;
+    vector<ray> hit_rays;
+    while (hits.size() < MICROBENCH_INPUTS)
+    {
+        double s = random_double(gen), t = random_double(gen);
+        ray r = cam.get_ray(s, t, gen);
+        if (rays.size() < MICROBENCH_INPUTS)
+        {
+            screen_s.push_back(s);
+            screen_t.push_back(t);
+            rays.push_back(r);
+        }
+
+        hit_record rec;
+        if (world_accel->hit(r, 0.001, INF, rec))
+        {
+            hits.push_back(rec);
+            hit_rays.push_back(r);
+        }
+    }
+
+    vector<vec3> vectors;
+    for (size_t i = 0; i < MICROBENCH_INPUTS; i++)
+        vectors.push_back(vec3::random_range(-10, 10, gen));
+
+    // the same vectors as vec4.h's padded SIMD vectors, in both precisions
+    vector<vec4_t<double>> vectors4d;
+    vector<vec4_t<float>> vectors4f;
+    for (const vec3& v : vectors)
+    {
+        vectors4d.emplace_back(v.x(), v.y(), v.z());
+        vectors4f.emplace_back(v.x(), v.y(), v.z());
+    }
+
+    // blocks of 4x4 neighboring pixels of a 400 pixel wide image of the random scene, one camera ray per pixel
+    const uint32_t block_width = 400, block_height = 225;
+    scene random_world;
+    make_scene("random", 0, random_world);
+    camera random_cam = random_world.view.make_camera(double(block_width) / block_height);
+    shared_ptr<hittable> random_accel = build_accel<sphere, sphere_soa>(random_world.spheres, accel_type::bvh4, bvh_split_method::sah);
+    vector<ray> blocks;
+    for (size_t i = 0; i < MICROBENCH_INPUTS; i++)
+    {
+        uint32_t x0 = static_cast<uint32_t>(random_double(gen) * (block_width - 4));
+        uint32_t y0 = static_cast<uint32_t>(random_double(gen) * (block_height - 4));
+        for (uint32_t p = 0; p < RAY_PACKET_MAX; p++)
+        {
+            double u = (x0 + p % 4 + random_double(gen)) / (block_width - 1);
+            double v = (y0 + p / 4 + random_double(gen)) / (block_height - 1);
+            blocks.push_back(random_cam.get_ray(u, v, gen));
+        }
+    }
+
+    const sphere& center_sphere = world.spheres[1];
+    lambertian diffuse(color(0.1, 0.2, 0.5));
+    metal fuzzy_metal(color(0.8, 0.6, 0.2), 0.3);
+    dielectric glass(1.5);
+    rng kernel_gen(2);
+
+    std::cout << "kernel,calls,reps,median_ns,min_ns\n";
+    auto run = [&](const char* name, auto kernel) {
+        if (!only.empty() && only != name)
+            return;
+        microbench_result result = time_kernel(kernel, reps, calls);
+        std::cout << name << "," << calls << "," << reps << "," << result.median_ns << "," << result.min_ns << std::endl;
+    };
+
+    // each vector operation on vec3 (as built, plain doubles by default), vec4_t<double> and vec4_t<float>
+    auto run_vector_op = [&](const std::string& op, auto kernel) {
+        run(("vec3_" + op).c_str(), [&](size_t i) { return double(kernel(vectors, i)); });
+        run(("vec4d_" + op).c_str(), [&](size_t i) { return double(kernel(vectors4d, i)); });
+        run(("vec4f_" + op).c_str(), [&](size_t i) { return double(kernel(vectors4f, i)); });
+    };
+    auto next = [](size_t i) { return (i + 1) & (MICROBENCH_INPUTS - 1); };
+    // all three components, so none of the work can be skipped
+    auto sum = [](const auto& v) { return v.x() + v.y() + v.z(); };
+
+    run_vector_op("add", [&](const auto& v, size_t i) { return sum(v[i] + v[next(i)]); });
+    run_vector_op("dot", [&](const auto& v, size_t i) { return dot(v[i], v[next(i)]); });
+    run_vector_op("cross", [&](const auto& v, size_t i) { return sum(cross(v[i], v[next(i)])); });
+    run_vector_op("normalize", [&](const auto& v, size_t i) { return sum(unit_vector(v[i])); });
+    // reflection about a normal, the core of metal::scatter: several operations in a row
+    run_vector_op("reflect", [&](const auto& v, size_t i) {
+        auto n = unit_vector(v[next(i)]);
+        return sum(v[i] - 2 * dot(v[i], n) * n);
+    });
+
+    run("sphere_hit", [&](size_t i) {
+        hit_record rec;
+        return center_sphere.hit(rays[i], 0.001, INF, rec) ? rec.time : 0.0;
+    });
+    // the 16 rays of a block one at a time, then in packets of 4 (2x2 pixels), 8 (4x2) and 16
+    run("primary16_single", [&](size_t i) {
+        double sum = 0;
+        for (uint32_t p = 0; p < RAY_PACKET_MAX; p++)
+        {
+            hit_record rec;
+            sum += random_accel->hit(blocks[i * RAY_PACKET_MAX + p], 0.001, INF, rec) ? rec.time : 0.0;
+        }
+        return sum;
+    });
+    auto run_packets = [&](const char* name, uint32_t size) {
+        // each packet covers a 2x2, 4x2 or 4x4 part of the block, as the renderer's do
+        uint32_t sub_width = size == 4 ? 2 : 4;
+        uint32_t sub_height = size / sub_width;
+        run(name, [&, size, sub_width, sub_height](size_t i) {
+            double sum = 0;
+            ray_packet packet;
+            for (uint32_t k = 0; k < RAY_PACKET_MAX / size; k++)
+            {
+                uint32_t x0 = k % (4 / sub_width) * sub_width;
+                uint32_t y0 = k / (4 / sub_width) * sub_height;
+                packet.reset(0.001, INF);
+                for (uint32_t lane = 0; lane < size; lane++)
+                    packet.add(blocks[i * RAY_PACKET_MAX + (y0 + lane / sub_width) * 4 + x0 + lane % sub_width]);
+
+                random_accel->hit_packet(packet);
+                for (uint32_t lane = 0; lane < size; lane++)
+                    sum += packet.hit_mask & (1u << lane) ? packet.rec[lane].time : 0.0;
+            }
+            return sum;
+        });
+    };
+    run_packets("primary16_packet4", 4);
+    run_packets("primary16_packet8", 8);
+    run_packets("primary16_packet16", 16);
+    run("lambertian_scatter", [&](size_t i) {
+        color attenuation;
+        ray scattered;
+        diffuse.scatter(hit_rays[i], hits[i], attenuation, scattered, kernel_gen);
+        return scattered.direction().x();
+    });
+    run("metal_scatter", [&](size_t i) {
+        color attenuation;
+        ray scattered;
+        fuzzy_metal.scatter(hit_rays[i], hits[i], attenuation, scattered, kernel_gen);
+        return scattered.direction().x();
+    });
+    run("dielectric_scatter", [&](size_t i) {
+        color attenuation;
+        ray scattered;
+        glass.scatter(hit_rays[i], hits[i], attenuation, scattered, kernel_gen);
+        return scattered.direction().x();
+    });
+    run("random_in_unit_sphere", [&](size_t) {
+        return random_in_unit_sphere(kernel_gen).x();
+    });
+    run("unit_vector", [&](size_t i) {
+        return unit_vector(vectors[i]).x();
+    });
+    run("camera_get_ray", [&](size_t i) {
+        return cam.get_ray(screen_s[i], screen_t[i], kernel_gen).direction().x();
+    });
+    run("rng_next", [&](size_t) {
+        return random_double(kernel_gen);
+    });
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+# Builds and runs the kernel microbenchmarks, appending their CSV to microbench.csv. Arguments are passed on,
+# e.g. ./microbench.sh --only sphere_hit
+g++ -O2 -march=native -pthread microbench.cpp -o microbench.exe && ./microbench.exe "$@" | tee -a microbench.csv
@@ -0,0 +1,135 @@
+// Checks that rays traced in packets (see ray_packet) get exactly the hits they get one at a time: same hit or
+// miss, time, material, side, point and normal, bit for bit, so packet_size never changes an image. Packets
+// are traced through a bvh4 of the scene's spheres, in three kinds:
+//  - coherent: camera rays of a 4x4 pixel block, all directions alike, so the packet is traced as one interval
+//  - mixed: the same origins in random directions, traced ray by ray
+//  - degenerate: camera rays with NaNs, a zero direction component or a zero direction mixed in, which must
+//    neither crash nor change the other rays' hits
+// Exits with 1 if any ray differs. packets.sh builds it and runs it on every scene.
+//
+// Usage: packets [--rays N] [any render setting, e.g. --scene random]
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "rt.h"
+#include "vec3.h"
+#include "ray.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+#include "accel.h"
+#include "camera.h"
+#include "scene.h"
+#include "settings.h"
+
+using std::vector;
+
+// same as the renderer's
+const double PACKETS_T_MIN = 0.001;
+
+inline bool identical(const vec3& a, const vec3& b)
+{
+    return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+// Traces rays of the given kind (0 coherent, 1 mixed, 2 degenerate) in full packets and checks every ray's
+// result against hit. Returns the number of rays that differ.
+uint64_t compare_packets(const hittable& accel, const camera& cam, int kind, uint64_t rays, rng& gen)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    uint64_t traced = 0, hits = 0, disagree = 0;
+    while (traced < rays)
+    {
+        ray_packet packet;
+        packet.reset(PACKETS_T_MIN, INF);
+        double u = random_double(gen), v = random_double(gen);
+        for (uint32_t i = 0; i < RAY_PACKET_MAX; i++)
+        {
+            ray r = cam.get_ray(u + (i % 4) * 0.002, v + (i / 4) * 0.002, gen);
+            vec3 dir = r.direction();
+            if (kind == 1)
+                dir = random_unit_vector(gen);
+            // one kind of degenerate ray per packet, in lanes 0, 4, 8 and 12, so a packet of otherwise coherent
+            // rays still reaches the interval test
+            if (kind == 2 && i % 4 == 0)
+            {
+                switch (traced / RAY_PACKET_MAX % 4)
+                {
+                case 0: r = ray(point3(nan, nan, nan), dir); break;
+                case 1: dir = vec3(nan, dir.y(), dir.z()); break;
+                case 2: dir = vec3(dir.x(), 0, dir.z()); break;
+                default: dir = vec3(0, 0, 0); break;
+                }
+            }
+            packet.add(ray(r.origin(), dir));
+        }
+
+        accel.hit_packet(packet);
+        for (uint32_t i = 0; i < packet.size; i++)
+        {
+            hit_record rec;
+            bool hit = accel.hit(packet.rays[i], PACKETS_T_MIN, INF, rec);
+            bool packet_hit = packet.hit_mask & (1u << i);
+            const hit_record& p = packet.rec[i];
+            bool same = hit == packet_hit;
+            if (same && hit)
+                same = rec.time == p.time && rec.mat == p.mat && rec.front_face == p.front_face &&
+                       identical(rec.point, p.point) && identical(rec.normal, p.normal);
+            disagree += !same;
+            hits += hit;
+            traced++;
+        }
+    }
+
+    const char* kinds[] = { "coherent", "mixed", "degenerate" };
+    std::cout << "  " << kinds[kind] << ": " << traced << " rays, " << hits << " hits, " << disagree << " differing\n";
+    return disagree;
+}
+
+int main(int argc, char** argv)
+{
+    render_settings settings;
+    uint64_t rays = 1 << 18;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || i + 1 >= argc)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--rays N] [--KEY VALUE]...\n";
+            return 1;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value = argv[++i];
+        bool ok = true;
+        if (key == "rays")
+            ok = parse_count(value, rays) && rays > 0;
+        else
+            ok = apply_setting(settings, key, value);
+
+        if (!ok)
+        {
+            std::cerr << "Bad argument '" << arg << " " << value << "'\n";
+            return 1;
+        }
+    }
+    if (!check_settings(settings))
+        return 1;
+
+    scene world;
+    make_scene(settings.scene, settings.scene_size, world);
+    camera cam = world.view.make_camera(settings.aspect_ratio);
+    shared_ptr<hittable> accel = build_accel<sphere, sphere_soa>(world.spheres, accel_type::bvh4, settings.bvh_split);
+    rng gen(settings.seed);
+
+    std::cout << "Packets of " << RAY_PACKET_MAX << " against single rays, scene " << settings.scene
+              << " (" << world.spheres.size() << " spheres):\n";
+    uint64_t disagree = 0;
+    for (int kind = 0; kind < 3; kind++)
+        disagree += compare_packets(*accel, cam, kind, rays, gen);
+    return disagree == 0 ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#!/bin/bash
+# Builds the packet check and runs it on every scene, failing if packets and single rays disagree on any.
+# Arguments are passed on, e.g. ./packets.sh --rays 10000
+g++ -O2 -march=native -pthread packets.cpp -o packets.exe || exit 1
+status=0
+for scene in default random glass enclosed; do
+    ./packets.exe --scene $scene "$@" || status=1
+done
+exit $status
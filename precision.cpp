@@ -0,0 +1,206 @@
+// Accuracy of a float build (-DRT_FLOAT, see real) against the default double one, in two parts:
+//  - kernels: camera rays into a scene are intersected with its spheres in double and in float, comparing
+//    which sphere is hit, where and with what normal, and how often a ray bounced off a surface hits that same
+//    surface again (shadow acne, the usual failure of low precision)
+//  - images: with --reference and --test, two PFM renders of the same settings are compared pixel by pixel.
+// precision.sh builds both renderers and runs everything.
+//
+// Usage: precision [--rays N] [--reference A.pfm --test B.pfm] [any render setting, e.g. --scene random]
+
+#ifdef RT_FLOAT
+#error "precision compares against double precision and must be built without RT_FLOAT"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "rt.h"
+#include "vec3.h"
+#include "ray.h"
+#include "sphere.h"
+#include "camera.h"
+#include "scene.h"
+#include "settings.h"
+#include "image.h"
+
+using std::vector;
+
+// same as the renderer's, so self-intersections are counted the way they would show up in a render
+const double PRECISION_T_MIN = 0.001;
+
+template <typename T>
+struct kernel_hit
+{
+    int sphere = -1; // index into the scene's spheres, -1 for a miss
+    T t = T(INF);
+    vec3_t<T> point;
+    vec3_t<T> normal; // facing against the ray
+};
+
+// nearest hit of r among all spheres, with every value computed in T
+template <typename T>
+kernel_hit<T> nearest_hit(const vector<sphere>& spheres, const ray_t<T>& r)
+{
+    kernel_hit<T> nearest;
+    for (size_t i = 0; i < spheres.size(); i++)
+    {
+        T root;
+        if (hit_sphere(vec3_t<T>(spheres[i].center), T(spheres[i].radius), r, T(PRECISION_T_MIN), nearest.t, root))
+        {
+            nearest.sphere = static_cast<int>(i);
+            nearest.t = root;
+        }
+    }
+
+    if (nearest.sphere >= 0)
+    {
+        const sphere& s = spheres[nearest.sphere];
+        nearest.point = r.at(nearest.t);
+        nearest.normal = (nearest.point - vec3_t<T>(s.center)) / T(s.radius);
+        if (dot(r.direction(), nearest.normal) > 0)
+            nearest.normal = -nearest.normal;
+    }
+    return nearest;
+}
+
+// Whether a ray leaving h's surface in direction normal + scatter hits the same sphere again. It can't: the ray
+// leaves the sphere (or, inside a hollow one, its inner surface) on the side the normal faces.
+template <typename T>
+bool hits_itself(const sphere& s, const kernel_hit<T>& h, const vec3& scatter)
+{
+    T root;
+    ray_t<T> bounce(h.point, h.normal + vec3_t<T>(scatter));
+    return hit_sphere(vec3_t<T>(s.center), T(s.radius), bounce, T(PRECISION_T_MIN), T(INF), root);
+}
+
+void compare_kernels(const render_settings& settings, uint64_t rays)
+{
+    scene world;
+    make_scene(settings.scene, settings.scene_size, world);
+    camera cam = world.view.make_camera(settings.aspect_ratio);
+    rng gen(settings.seed);
+
+    uint64_t hits = 0, misses_disagree = 0, spheres_disagree = 0;
+    uint64_t self_hits_double = 0, self_hits_float = 0;
+    double t_error_sum = 0, t_error_max = 0, point_error_sum = 0, point_error_max = 0, normal_error_max = 0;
+
+    for (uint64_t i = 0; i < rays; i++)
+    {
+        ray r = cam.get_ray(random_double(gen), random_double(gen), gen);
+        kernel_hit<double> d = nearest_hit(world.spheres, r);
+        kernel_hit<float> f = nearest_hit(world.spheres, ray_t<float>(vec3_t<float>(r.origin()), vec3_t<float>(r.direction())));
+
+        if ((d.sphere < 0) != (f.sphere < 0))
+            misses_disagree++;
+        if (d.sphere < 0 || f.sphere < 0)
+            continue;
+        if (d.sphere != f.sphere)
+        {
+            spheres_disagree++;
+            continue;
+        }
+
+        hits++;
+        double t_error = std::fabs(f.t - d.t) / d.t;
+        double point_error = (vec3(f.point) - d.point).length();
+        double cos_angle = clamp(dot(vec3(f.normal), d.normal) / vec3(f.normal).length(), -1.0, 1.0);
+        t_error_sum += t_error;
+        point_error_sum += point_error;
+        t_error_max = std::max(t_error_max, t_error);
+        point_error_max = std::max(point_error_max, point_error);
+        normal_error_max = std::max(normal_error_max, std::acos(cos_angle) * 180 / PI);
+
+        const sphere& s = world.spheres[d.sphere];
+        vec3 scatter = random_unit_vector(gen);
+        self_hits_double += hits_itself(s, d, scatter);
+        self_hits_float += hits_itself(s, f, scatter);
+    }
+
+    std::cout << "Kernels: " << rays << " camera rays into scene " << settings.scene << " (" << world.spheres.size() << " spheres)\n"
+              << "  hit in one precision, missed in the other: " << misses_disagree << "\n"
+              << "  nearest sphere differs:                    " << spheres_disagree << "\n"
+              << "  same sphere hit:                           " << hits << "\n";
+    if (hits == 0)
+        return;
+    std::cout << "  hit distance relative error:               mean " << t_error_sum / hits << ", max " << t_error_max << "\n"
+              << "  hit point error:                           mean " << point_error_sum / hits << ", max " << point_error_max << "\n"
+              << "  normal angle error:                        max " << normal_error_max << " degrees\n"
+              << "  bounces hitting their own surface:         double " << self_hits_double << ", float " << self_hits_float
+              << " (" << 100.0 * self_hits_float / hits << "%)\n";
+}
+
+bool compare_images(const std::string& reference_path, const std::string& test_path)
+{
+    hdr_buffer reference, test;
+    if (!read_pfm(reference_path, reference) || !read_pfm(test_path, test))
+    {
+        std::cerr << "Can't read '" << reference_path << "' or '" << test_path << "'\n";
+        return false;
+    }
+    if (reference.width != test.width || reference.height != test.height)
+    {
+        std::cerr << "Images differ in size\n";
+        return false;
+    }
+
+    double abs_sum = 0, square_sum = 0, max_error = 0, reference_sum = 0;
+    for (size_t i = 0; i < reference.radiance.size(); i++)
+    {
+        double error = std::fabs(double(test.radiance[i]) - reference.radiance[i]);
+        abs_sum += error;
+        square_sum += error * error;
+        max_error = std::max(max_error, error);
+        reference_sum += std::fabs(reference.radiance[i]);
+    }
+
+    size_t n = reference.radiance.size();
+    std::cout << "Images: " << test_path << " against " << reference_path << " (" << reference.width << "x" << reference.height << ")\n"
+              << "  radiance error: mean " << abs_sum / n << ", RMS " << std::sqrt(square_sum / n) << ", max " << max_error << "\n"
+              << "  relative to the mean radiance: " << (reference_sum > 0 ? abs_sum / reference_sum : 0.0) << "\n";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    render_settings settings;
+    uint64_t rays = 1 << 18;
+    std::string reference, test;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || i + 1 >= argc)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--rays N] [--reference A.pfm --test B.pfm] [--KEY VALUE]...\n";
+            return 1;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value = argv[++i];
+        bool ok = true;
+        if (key == "rays")
+            ok = parse_count(value, rays) && rays > 0;
+        else if (key == "reference")
+            reference = value;
+        else if (key == "test")
+            test = value;
+        else
+            ok = apply_setting(settings, key, value);
+
+        if (!ok)
+        {
+            std::cerr << "Bad argument '" << arg << " " << value << "'\n";
+            return 1;
+        }
+    }
+    if (!check_settings(settings))
+        return 1;
+
+    compare_kernels(settings, rays);
+    if (!reference.empty() || !test.empty())
+        return compare_images(reference, test) ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#!/bin/bash
+# Builds the renderer in double and in float (-DRT_FLOAT), renders the same image with both and reports how far
+# apart their kernels and images are. Arguments are render settings passed to both, e.g. ./precision.sh --scene random
+g++ -O2 -march=native -pthread main.cpp -o raytracing.exe \
+    && g++ -O2 -march=native -pthread -DRT_FLOAT main.cpp -o raytracing_float.exe \
+    && g++ -O2 -march=native -pthread precision.cpp -o precision.exe \
+    && ./raytracing.exe --progress 0 "$@" --output precision_double.png --hdr_output precision_double.pfm \
+    && ./raytracing_float.exe --progress 0 "$@" --output precision_float.png --hdr_output precision_float.pfm \
+    && ./precision.exe "$@" --reference precision_double.pfm --test precision_float.pfm
@@ -3,21 +3,24 @@
 
 #include "vec3.h"
 
-struct ray {
-    point3 orig;
-    vec3 dir;
+template <typename T>
+struct ray_t {
+    vec3_t<T> orig;
+    vec3_t<T> dir;
     
-    ray() {}
-    ray(const point3& origin, const vec3& direction)
+    ray_t() {}
+    ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction)
         : orig(origin), dir(direction)
     {}
 
-    point3 origin() const  { return orig; }
-    vec3 direction() const { return dir; }
+    vec3_t<T> origin() const  { return orig; }
+    vec3_t<T> direction() const { return dir; }
 
-    point3 at(double t) const {
+    vec3_t<T> at(T t) const {
         return orig + t*dir;
     }
 };
 
+using ray = ray_t<real>;
+
 #endif // RT_RAY
\ No newline at end of file
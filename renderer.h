@@ -0,0 +1,368 @@
+#ifndef RT_RENDERER
+#define RT_RENDERER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "rt.h"
+#include "ray.h"
+#include "camera.h"
+#include "material.h"
+#include "hittable.h"
+#include "image.h"
+#include "settings.h"
+#include "thread_pool.h"
+#include "tile.h"
+#include "adaptive.h"
+#include "trace.h"
+
+using std::vector;
+
+// With checkpointing on, uniform renders are split into passes of this many samples per pixel, since
+// checkpoints can only be taken between passes.
+const uint32_t CHECKPOINT_PASS_SAMPLES = 16;
+
+// Follows one path until it escapes to the sky, is absorbed, or runs out of bounces. Instead of recursing per
+// bounce, the product of the attenuations so far (throughput) is carried along and applied to the sky color.
+// Paths may be cut short by russian roulette once they have made rr_depth bounces.
+// If packet is given, primary is its ray in lane and has already been intersected with the world there.
+color ray_color(const ray& primary, const hittable &world, int max_depth, int rr_depth, rng& gen,
+                const ray_packet* packet = nullptr, uint32_t lane = 0) {
+    ray r = primary;
+    color throughput(1, 1, 1);
+    color radiance(0, 0, 0);
+    int segments = 0;
+
+    for (int depth = 0; depth < max_depth; depth++)
+    {
+        hit_record rec;
+        segments++;
+        if (depth == 0)
+            RT_STAT_INC(primary_rays);
+        else
+            RT_STAT_INC(bounce_rays);
+
+        // t_min = 0.001 so rays don't collide with surface they were just reflected off of (called shadow acne)
+        bool hit;
+        if (depth == 0 && packet)
+        {
+            hit = packet->hit_mask & (1u << lane);
+            rec = packet->rec[lane];
+        }
+        else
+            hit = world.hit(r, 0.001, INF, rec);
+
+        if( !hit )
+        {
+            vec3 dir = unit_vector(r.direction());
+            double t = 0.5 * (dir.y() + 1.0);
+            // lerp
+            radiance += throughput * ((1.0 - t) * color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0));
+            break;
+        }
+
+        // using random_unit_vector over random_in_unit_sphere results in more uniform scattering of light rays (fewer rays scattering toward the normal)
+        // point3 target = rec.point + rec.normal + random_unit_vector(gen);
+
+        // alternative diffuse method that doesn't offset by surface's normal, about equivalent but has minor differences
+        // point3 target = rec.point + random_in_hemisphere(rec.normal, gen);
+
+        ray scattered;
+        color attenuation;
+        if (!rec.mat->scatter(r, rec, attenuation, scattered, gen))
+            break;
+
+        throughput = throughput * attenuation;
+        // nothing this path picks up from here on can still show up in the image
+        if (throughput.near_zero())
+            break;
+
+        // Russian roulette: continue dim paths only with probability p, and weight the survivors by 1/p so the
+        // expected value is unchanged. Most of the cost of long dark paths goes away for a bit more noise.
+        if (depth + 1 >= rr_depth)
+        {
+            double p = fmin(fmax(throughput.r(), fmax(throughput.g(), throughput.b())), 0.95);
+            if (random_double(gen) >= p)
+                break;
+            throughput /= p;
+        }
+
+        r = scattered;
+    }
+
+    RT_STAT_INC(path_length[segments < STATS_PATH_BUCKETS ? segments : STATS_PATH_BUCKETS - 1]);
+    return radiance;
+}
+
+// Camera ray of a sample of pixel (x, y), jittered within the pixel; gen is the sample's, see rng::for_sample.
+inline ray camera_ray(const render_settings& settings, const camera& cam, uint32_t x, uint32_t y, rng& gen)
+{
+    double u = (double(x) + random_double(gen)) / (settings.image_width - 1);
+    double v = (double(y) + random_double(gen)) / (settings.image_height() - 1);
+    return cam.get_ray(u, v, gen);
+}
+
+// Sums samples [first_sample, first_sample + count) of pixel (x, y), summed in double so long renders don't
+// lose precision. Each sample is also added to estimate, if given.
+inline color render_pixel(const render_settings& settings, const camera& cam, const hittable& world, uint32_t x, uint32_t y,
+                          uint32_t first_sample, uint32_t count, pixel_estimate* estimate = nullptr)
+{
+    uint64_t pixel = uint64_t(y) * settings.image_width + x;
+
+    color sum(0, 0, 0);
+    for (uint32_t s = first_sample; s < first_sample + count; s++)
+    {
+        rng gen = rng::for_sample(settings.seed, pixel, s);
+        ray ray = camera_ray(settings, cam, x, y, gen);
+
+        color sample = ray_color(ray, world, settings.max_depth, settings.russian_roulette_depth, gen);
+        sum += sample;
+        if (estimate)
+            estimate->add(sample);
+    }
+    return sum;
+}
+
+// Same as render_pixel for each of a few neighboring pixels (at most RAY_PACKET_MAX): pixel i takes samples
+// [first_sample[i], first_sample[i] + count[i]) into sums[i] and estimates[pixels[i]], if given. The camera rays
+// of each sample index are traced as one packet; after the first hit the paths scatter in unrelated directions
+// and continue one ray at a time.
+inline void render_pixel_packet(const render_settings& settings, const camera& cam, const hittable& world,
+                                const uint64_t* pixels, uint32_t pixel_count, const uint32_t* first_sample,
+                                const uint32_t* count, color* sums, pixel_estimate* estimates = nullptr)
+{
+    uint32_t width = settings.image_width;
+    uint32_t max_count = 0;
+    for (uint32_t i = 0; i < pixel_count; i++)
+    {
+        sums[i] = color(0, 0, 0);
+        max_count = std::max(max_count, count[i]);
+    }
+
+    ray_packet packet;
+    rng gens[RAY_PACKET_MAX];
+    uint32_t lane_pixel[RAY_PACKET_MAX];
+    for (uint32_t s = 0; s < max_count; s++)
+    {
+        packet.reset(0.001, INF);
+        for (uint32_t i = 0; i < pixel_count; i++)
+        {
+            if (s >= count[i])
+                continue;
+            uint64_t pixel = pixels[i];
+            rng gen = rng::for_sample(settings.seed, pixel, first_sample[i] + s);
+            ray r = camera_ray(settings, cam, uint32_t(pixel % width), uint32_t(pixel / width), gen);
+            uint32_t lane = packet.add(r);
+            gens[lane] = gen;
+            lane_pixel[lane] = i;
+        }
+
+        world.hit_packet(packet);
+
+        for (uint32_t lane = 0; lane < packet.size; lane++)
+        {
+            uint32_t i = lane_pixel[lane];
+            color sample = ray_color(packet.rays[lane], world, settings.max_depth, settings.russian_roulette_depth,
+                                     gens[lane], &packet, lane);
+            sums[i] += sample;
+            if (estimates)
+                estimates[pixels[i]].add(sample);
+        }
+    }
+}
+
+// Renders one frame of a scene as configured by a render_settings: owns the thread pool, the tiles and the
+// radiance accumulated for every pixel.
+struct renderer
+{
+    const render_settings& settings;
+    const camera& cam;
+    const hittable& world;
+
+    thread_pool pool;
+    vector<tile> tiles;
+    hdr_buffer accum;                 // samples taken so far; row-major, y = 0 is the bottom row
+    vector<pixel_estimate> estimates; // convergence of each pixel, for adaptive sampling
+    // Samples taken over the whole frame. Together with accum and estimates this is all the state of a render:
+    // render() picks up from it, which is what lets a checkpointed render be resumed.
+    uint64_t samples_taken = 0;
+    // nanoseconds spent rendering each pixel, over all passes; only recorded when settings.heatmap is set
+    vector<double> pixel_ns;
+
+    // if set, called on the rendering thread after every pass, when the state above is consistent
+    std::function<void(const renderer&)> on_pass;
+
+    renderer(const render_settings& _settings, const camera& _cam, const hittable& _world)
+        : settings(_settings), cam(_cam), world(_world), pool(_settings.threads),
+          accum(_settings.image_width, _settings.image_height())
+    {
+        tiles = make_tiles(settings.image_width, settings.image_height(), settings.tile_size);
+        estimates.resize(settings.pixel_count());
+        if (!settings.heatmap.empty())
+            pixel_ns.resize(settings.pixel_count());
+    }
+
+    // Takes extra_samples[pixel] more samples of every pixel, continuing where its sample sequence left off.
+    // Tiles never overlap, so each pixel has exactly one writer.
+    void render_pass(const vector<uint32_t>& extra_samples);
+
+    // Takes samples until there are samples_per_pixel of every pixel: in one pass, in doubling passes when
+    // progressive is set, or spread out by error when adaptive is set.
+    void render();
+
+private:
+    std::mutex progress_mutex;
+
+    // render_pass's work on one tile, with camera rays traced in packets of settings.packet_size
+    void render_tile_packets(const tile& t, const vector<uint32_t>& extra_samples);
+
+    void render_adaptive();
+};
+
+void renderer::render_pass(const vector<uint32_t>& extra_samples)
+{
+    trace_scope trace_pass("pass");
+    uint32_t width = settings.image_width;
+    bool timed = !pixel_ns.empty();
+    std::atomic<size_t> tiles_done{0};
+
+    pool.parallel_for(tiles.size(), [&](size_t tile_idx, unsigned) {
+        const tile& t = tiles[tile_idx];
+        trace_scope trace_tile("tile", tile_idx);
+
+        if (settings.packet_size > 1)
+            render_tile_packets(t, extra_samples);
+        else
+        {
+            for( uint32_t y = t.y1; y-- > t.y0; )
+            {
+                for( uint32_t x = t.x0; x < t.x1; x++)
+                {
+                    uint64_t pixel = uint64_t(y) * width + x;
+                    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+                    color pass_sum = render_pixel(settings, cam, world, x, y, accum.samples[pixel], extra_samples[pixel], &estimates[pixel]);
+                    accum.add(pixel, pass_sum, extra_samples[pixel]);
+
+                    if (timed)
+                        pixel_ns[pixel] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                }
+            }
+        }
+
+        size_t done = ++tiles_done;
+        if (!settings.progress)
+            return;
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        std::cerr << "\rTiles remaining: " << tiles.size() - done << ' ' << std::flush;
+    });
+
+    for (uint32_t n : extra_samples)
+        samples_taken += n;
+
+    if (on_pass)
+        on_pass(*this);
+}
+
+void renderer::render_tile_packets(const tile& t, const vector<uint32_t>& extra_samples)
+{
+    uint32_t width = settings.image_width;
+    bool timed = !pixel_ns.empty();
+    // packets cover square-ish blocks, so their rays stay close together
+    uint32_t block_w = settings.packet_size == 4 ? 2 : 4;
+    uint32_t block_h = settings.packet_size / block_w;
+
+    for (uint32_t y1 = t.y1; y1 > t.y0; )
+    {
+        uint32_t y0 = y1 - t.y0 > block_h ? y1 - block_h : t.y0;
+        for (uint32_t x0 = t.x0; x0 < t.x1; x0 += block_w)
+        {
+            uint64_t pixels[RAY_PACKET_MAX];
+            uint32_t first_sample[RAY_PACKET_MAX], count[RAY_PACKET_MAX];
+            color sums[RAY_PACKET_MAX];
+            uint32_t pixel_count = 0;
+            for (uint32_t y = y1; y-- > y0; )
+            {
+                for (uint32_t x = x0; x < std::min(x0 + block_w, t.x1); x++)
+                {
+                    uint64_t pixel = uint64_t(y) * width + x;
+                    pixels[pixel_count] = pixel;
+                    first_sample[pixel_count] = accum.samples[pixel];
+                    count[pixel_count] = extra_samples[pixel];
+                    pixel_count++;
+                }
+            }
+
+            auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            render_pixel_packet(settings, cam, world, pixels, pixel_count, first_sample, count, sums, estimates.data());
+            for (uint32_t i = 0; i < pixel_count; i++)
+                accum.add(pixels[i], sums[i], count[i]);
+
+            // the pixels of a packet are traced together, so its time is split evenly between them
+            if (timed)
+            {
+                double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                for (uint32_t i = 0; i < pixel_count; i++)
+                    pixel_ns[pixels[i]] += ns / pixel_count;
+            }
+        }
+        y1 = y0;
+    }
+}
+
+void renderer::render()
+{
+    if (settings.adaptive)
+    {
+        render_adaptive();
+        return;
+    }
+
+    size_t pixel_count = estimates.size();
+    while (samples_taken < uint64_t(settings.samples_per_pixel) * pixel_count)
+    {
+        uint32_t done = static_cast<uint32_t>(samples_taken / pixel_count);
+        uint32_t pass_samples = settings.samples_per_pixel - done;
+        // each pass doubles the samples so far (1, 2, 4, ...), so a first preview comes quickly and later ones visibly improve
+        if (settings.progressive)
+            pass_samples = std::min(pass_samples, done + 1);
+        else if (!settings.checkpoint.empty())
+            pass_samples = std::min(pass_samples, CHECKPOINT_PASS_SAMPLES);
+
+        if (pass_samples < settings.samples_per_pixel)
+            std::cerr << "\nPass: " << pass_samples << " spp, " << done + pass_samples << " of " << settings.samples_per_pixel << "\n";
+        render_pass(vector<uint32_t>(pixel_count, pass_samples));
+    }
+}
+
+void renderer::render_adaptive()
+{
+    size_t pixel_count = estimates.size();
+    uint64_t total = uint64_t(settings.samples_per_pixel) * pixel_count;
+
+    if (samples_taken == 0)
+        render_pass(vector<uint32_t>(pixel_count, std::min(settings.adaptive_min_samples, settings.samples_per_pixel)));
+
+    while (samples_taken < total)
+    {
+        uint64_t budget = total - samples_taken;
+        uint64_t pass_budget = std::min<uint64_t>(budget, uint64_t(settings.adaptive_pass_samples) * pixel_count);
+        vector<uint32_t> extra = allocate_adaptive_samples(estimates, pass_budget, settings);
+        uint64_t pass_samples = 0;
+        for (uint32_t n : extra)
+            pass_samples += n;
+        if (pass_samples == 0)
+            break;
+
+        std::cerr << "\nAdaptive pass: " << pass_samples << " samples, " << budget << " left in budget\n";
+        render_pass(extra);
+    }
+}
+
+#endif // RT_RENDERER
@@ -4,16 +4,21 @@
 #include <limits>
 #include <cmath>
 #include <memory>
-#include <cstdlib>
+#include <cstdint>
+#include <cstring>
 
 using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
-const double ASPECT_RATIO = 16.0 / 9.0;
-const int IMAGE_WIDTH = 400;
-const int IMAGE_HEIGHT = static_cast<int>(IMAGE_WIDTH / ASPECT_RATIO);
-const int MAX_DEPTH = 50; // how deep should we go in raycast bounces?
+// Scalar type of the geometry: vectors, rays, hit records and intersection tests. Built with -DRT_FLOAT it is
+// float, which halves the size of all of them and fits twice as many lanes in a SIMD register, for some loss
+// of accuracy (measure it with precision.sh). Colors and sample sums stay double either way.
+#ifdef RT_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
 
 const double PI = 3.1415926535897932385;
 const double INF = std::numeric_limits<double>::infinity();
@@ -29,15 +34,86 @@ inline double clamp(double x, double min, double max) {
     return x;
 }
 
+// Nearest floats at or below and at or above x, for float tests that must not lose anything x would pass. The
+// conversion rounds to nearest, and when that went the wrong way the float is moved one ulp by stepping its bits,
+// without a branch: which way the rounding went is as good as random (std::nextafter is also a library call).
+inline float float_step(float f, int32_t dir) // dir: -1 down, 1 up, 0 stay
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(f));
+    // the bits order positive floats by value and negative ones the other way round
+    bits += (bits >> 31) ? -dir : dir;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline float float_below(real x)
+{
+    float f = static_cast<float>(x);
+    return float_step(f, -int32_t(f > x));
+}
+
+inline float float_above(real x)
+{
+    float f = static_cast<float>(x);
+    return float_step(f, int32_t(f < x));
+}
+
+// splitmix64 finalizer, used to turn structured values (seed, pixel, sample) into well mixed bits
+inline uint64_t hash64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// PCG32 (O'Neill, pcg-random.org): 16 bytes of state, a multiply-add and a rotate per number.
+// Generators are passed explicitly to everything that needs randomness, so there is no shared state between threads.
+struct rng
+{
+    uint64_t state;
+    uint64_t inc; // stream selector, always odd
+
+    rng(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL)
+    {
+        state = 0;
+        inc = (stream << 1) | 1;
+        next_u32();
+        state += seed;
+        next_u32();
+    }
+
+    // Independent sequence for one sample of one pixel. Every sample gets its own generator, so the image
+    // doesn't depend on thread count, tile size or the order in which pixels and samples are visited. The sample
+    // picks the stream and is hashed into the starting state as well: PCG streams started from the same state
+    // give correlated sequences.
+    static rng for_sample(uint64_t seed, uint64_t pixel, uint64_t sample)
+    {
+        return rng(hash64(seed ^ hash64(pixel) ^ hash64(sample + 0x9e3779b97f4a7c15ULL)), sample);
+    }
+
+    uint32_t next_u32()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+};
+
 // [0, 1)
-inline double random_double()
+inline double random_double(rng& gen)
 {
-    return rand() / (RAND_MAX + 1.0);
+    return gen.next_u32() * (1.0 / 4294967296.0);
 }
 
-inline double random_double_range(double min, double max)
+inline double random_double_range(double min, double max, rng& gen)
 {
-    return min + (max - min) * random_double();
+    return min + (max - min) * random_double(gen);
 }
 
 #endif // RT
\ No newline at end of file
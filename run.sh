@@ -1,3 +1,6 @@
 #!/bin/bash
 rm image.png
-g++ main.cpp -o raytracing.exe; ./raytracing
\ No newline at end of file
+# add -DRT_STATS for ray counts, Mrays/s and a path length histogram at the end of the render
+# add -DRT_FLOAT for single precision geometry, see precision.sh for what it costs in accuracy
+# add -DRT_SIMD_VEC for SIMD vectors padded to four lanes (vec4.h), compare with microbench.sh
+g++ -O2 -march=native -pthread main.cpp -o raytracing.exe; ./raytracing
\ No newline at end of file
@@ -0,0 +1,198 @@
+#ifndef RT_SCENE
+#define RT_SCENE
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "rt.h"
+#include "sphere.h"
+#include "material.h"
+#include "camera.h"
+
+using std::vector;
+
+// where a scene is looked at from, everything the camera needs except the image's aspect ratio
+struct scene_view
+{
+    point3 look_from = point3(0, 0, 0);
+    point3 look_at = point3(0, 0, -1);
+    vec3 up = vec3(0, 1, 0);
+    double vfov = 20;
+    double aperture = 0;
+    double focus_dist = 1;
+
+    camera make_camera(double aspect_ratio) const
+    {
+        return camera(look_from, look_at, up, vfov, aspect_ratio, aperture, focus_dist);
+    }
+};
+
+// Everything in a world. The scene owns the materials and objects only hold raw pointers to them, so copying a
+// hit_record while tracing never touches a reference count. Spheres are kept by value so acceleration structures
+// can copy them straight into their leaves.
+struct scene
+{
+    vector<shared_ptr<material>> materials;
+    vector<sphere> spheres;
+    scene_view view;
+
+    // takes ownership of mat, returning the pointer objects should refer to it by
+    const material* add_material(shared_ptr<material> mat)
+    {
+        materials.push_back(mat);
+        return mat.get();
+    }
+
+    void add(const sphere& s)
+    {
+        spheres.push_back(s);
+    }
+};
+
+// The scenes below are deterministic: ones with random placement take the seed of their generator, so the
+// same arguments always give the same scene (benchmarks rely on this).
+
+// the book's first camera-and-defocus scene: three spheres on a big one, the left one a hollow glass sphere
+inline scene default_scene()
+{
+    scene world;
+
+    auto material_ground = world.add_material(make_shared<lambertian>(color(0.8, 0.8, 0.0)));
+    auto material_center = world.add_material(make_shared<lambertian>(color(0.1, 0.2, 0.5)));
+    auto material_left   = world.add_material(make_shared<dielectric>(1.5));
+    auto material_right  = world.add_material(make_shared<metal>(color(0.8, 0.6, 0.2), 0.0));
+
+    world.add(sphere(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
+    world.add(sphere(point3( 0.0,    0.0, -1.0),   0.5, material_center));
+    world.add(sphere(point3(-1.0,    0.0, -1.0),   0.5, material_left));
+    world.add(sphere(point3(-1.0,    0.0, -1.0), -0.45, material_left));
+    world.add(sphere(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+
+    world.view.look_from = point3(3, 3, 2);
+    world.view.look_at = point3(0, 0, -1);
+    world.view.aperture = 2.0;
+    world.view.focus_dist = (world.view.look_at - world.view.look_from).length();
+    return world;
+}
+
+// The book's final scene: a grid of about count small random spheres (80% diffuse, 15% metal, 5% glass) around
+// three big ones. count = 484 is the book's 22 x 22 grid; larger counts spread the grid further out.
+inline scene random_spheres_scene(uint32_t count, uint64_t seed = 1)
+{
+    scene world;
+    rng gen(seed);
+
+    world.add(sphere(point3(0, -1000, 0), 1000, world.add_material(make_shared<lambertian>(color(0.5, 0.5, 0.5)))));
+
+    int half = static_cast<int>(std::ceil(std::sqrt(double(count)) / 2));
+    for (int a = -half; a < half; a++)
+    {
+        for (int b = -half; b < half; b++)
+        {
+            double choose_mat = random_double(gen);
+            point3 center(a + 0.9 * random_double(gen), 0.2, b + 0.9 * random_double(gen));
+            if ((center - point3(4, 0.2, 0)).length() <= 0.9)
+                continue;
+
+            shared_ptr<material> mat;
+            if (choose_mat < 0.8)
+                mat = make_shared<lambertian>(color::random(gen) * color::random(gen));
+            else if (choose_mat < 0.95)
+                mat = make_shared<metal>(color::random_range(0.5, 1, gen), random_double_range(0, 0.5, gen));
+            else
+                mat = make_shared<dielectric>(1.5);
+            world.add(sphere(center, 0.2, world.add_material(mat)));
+        }
+    }
+
+    world.add(sphere(point3(0, 1, 0), 1.0, world.add_material(make_shared<dielectric>(1.5))));
+    world.add(sphere(point3(-4, 1, 0), 1.0, world.add_material(make_shared<lambertian>(color(0.4, 0.2, 0.1)))));
+    world.add(sphere(point3(4, 1, 0), 1.0, world.add_material(make_shared<metal>(color(0.7, 0.6, 0.5), 0.0))));
+
+    world.view.look_from = point3(13, 2, 3);
+    world.view.look_at = point3(0, 0, 0);
+    world.view.aperture = 0.1;
+    world.view.focus_dist = 10.0;
+    return world;
+}
+
+// Glass-heavy: a grid of about count glass spheres, every other one hollow, on a checker of two diffuse
+// colors. Nearly every path refracts several times before it gets anywhere.
+inline scene glass_scene(uint32_t count, uint64_t seed = 1)
+{
+    scene world;
+    rng gen(seed);
+
+    world.add(sphere(point3(0, -1000, 0), 1000, world.add_material(make_shared<lambertian>(color(0.2, 0.3, 0.1)))));
+    const material* glass = world.add_material(make_shared<dielectric>(1.5));
+    const material* dense_glass = world.add_material(make_shared<dielectric>(2.4));
+
+    int side = std::max(1, static_cast<int>(std::ceil(std::sqrt(double(count)))));
+    double spacing = 1.1;
+    for (int a = 0; a < side; a++)
+    {
+        for (int b = 0; b < side; b++)
+        {
+            double radius = 0.3 + 0.2 * random_double(gen);
+            point3 center((a - side / 2.0) * spacing, radius, (b - side / 2.0) * spacing);
+            world.add(sphere(center, radius, random_double(gen) < 0.3 ? dense_glass : glass));
+            if ((a + b) % 2 == 0)
+                world.add(sphere(center, -0.8 * radius, glass));
+        }
+    }
+
+    world.view.look_from = point3(0, 0.6 * side + 2, 0.9 * side + 3);
+    world.view.look_at = point3(0, 0, 0);
+    world.view.vfov = 40;
+    world.view.focus_dist = (world.view.look_at - world.view.look_from).length();
+    return world;
+}
+
+// Deep bounces: the camera sits inside a glass shell lined with about count bright diffuse and mirror spheres,
+// so light from the sky only gets in through the glass and paths bounce around many times before leaving.
+inline scene enclosed_scene(uint32_t count, uint64_t seed = 1)
+{
+    scene world;
+    rng gen(seed);
+
+    const material* shell = world.add_material(make_shared<dielectric>(1.5));
+    world.add(sphere(point3(0, 0, 0), 10.0, shell));
+    world.add(sphere(point3(0, 0, 0), -9.8, shell));
+
+    const material* white = world.add_material(make_shared<lambertian>(color(0.9, 0.9, 0.9)));
+    const material* mirror = world.add_material(make_shared<metal>(color(0.95, 0.95, 0.95), 0.05));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // random points on a sphere just inside the shell
+        vec3 dir = random_unit_vector(gen);
+        double radius = 1.0 + 1.0 * random_double(gen);
+        world.add(sphere(point3(0, 0, 0) + (9.6 - radius) * dir, radius, random_double(gen) < 0.5 ? white : mirror));
+    }
+
+    world.view.look_from = point3(0, 0, 4);
+    world.view.look_at = point3(0, 0, 0);
+    world.view.vfov = 90;
+    world.view.focus_dist = 4;
+    return world;
+}
+
+// Scene by name, for the command line and the benchmarks. size is the rough sphere count of the scenes that
+// take one, 0 for their default. Returns false for unknown names.
+inline bool make_scene(const std::string& name, uint32_t size, scene& out)
+{
+    if (name == "default")
+        out = default_scene();
+    else if (name == "random")
+        out = random_spheres_scene(size > 0 ? size : 484);
+    else if (name == "glass")
+        out = glass_scene(size > 0 ? size : 64);
+    else if (name == "enclosed")
+        out = enclosed_scene(size > 0 ? size : 256);
+    else
+        return false;
+    return true;
+}
+
+#endif // RT_SCENE
@@ -0,0 +1,364 @@
+#ifndef RT_SETTINGS
+#define RT_SETTINGS
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "accel.h"
+
+// Everything about a render that can change without rebuilding. Filled in from the command line and/or a config
+// file (see parse_settings), then passed by reference to the camera, image buffer and renderer.
+struct render_settings
+{
+    std::string scene = "default"; // see make_scene
+    uint32_t scene_size = 0;       // rough sphere count of scenes that take one, 0 for their default
+
+    double aspect_ratio = 16.0 / 9.0;
+    uint32_t image_width = 400;
+    uint32_t samples_per_pixel = 100;
+    int max_depth = 50; // how deep should we go in raycast bounces?
+    // bounces after which paths may be terminated by russian roulette (max_depth or more turns it off)
+    int russian_roulette_depth = 3;
+
+    uint32_t tile_size = 32; // width and height in pixels of each unit of render work
+    unsigned threads = 0;    // 0 = one per hardware thread
+    unsigned workers = 0;    // > 0: render in this many worker processes instead (see render_distributed)
+    uint64_t seed = 1;
+
+    accel_type accel = accel_type::bvh4;
+    bvh_split_method bvh_split = bvh_split_method::sah;
+    // Camera rays traced together as one packet (see ray_packet), from a block of neighboring pixels: 4, 8 or
+    // 16, or 1 to trace every ray on its own. Only bvh4 traverses packets, the other accelerators loop over them.
+    // Not supported with workers.
+    uint32_t packet_size = 1;
+
+    // Adaptive sampling: every pixel first gets adaptive_min_samples, then the rest of the frame's budget of
+    // samples_per_pixel * pixel count is handed out in passes, in proportion to each pixel's estimated error.
+    // Pixels whose error is already below adaptive_max_error get no more samples.
+    bool adaptive = false;
+    uint32_t adaptive_min_samples = 16;
+    uint32_t adaptive_max_samples = 1024;
+    uint32_t adaptive_pass_samples = 16; // average samples per pixel handed out per pass
+    // converged when the standard error of the mean luminance is below this fraction of the mean
+    double adaptive_max_error = 0.01;
+
+    // Progressive: the frame is rendered in passes of 1, 2, 4, ... samples per pixel (up to samples_per_pixel in
+    // total, so the final image is the same), and output is rewritten with the samples so far at most every
+    // snapshot_interval seconds.
+    bool progressive = false;
+    double snapshot_interval = 1.0;
+
+    // Checkpointing: the render state is saved to checkpoint (if set) between passes, at most every
+    // checkpoint_interval seconds. resume continues from that file instead of starting over.
+    std::string checkpoint;
+    double checkpoint_interval = 60.0;
+    bool resume = false;
+
+    std::string output = "image.png";
+    bool progress = true; // print tiles remaining
+    std::string hdr_output;    // if set, the linear radiance is also written here as a PFM
+    std::string heatmap;       // if set, a false-color PNG of the time spent on each pixel is written here
+    std::string trace;         // if set, a timeline of the render is written here as Chrome trace-event JSON
+    std::string tonemap_input; // if set, nothing is rendered: this PFM is tonemapped to output instead
+
+    uint32_t image_height() const { return static_cast<uint32_t>(image_width / aspect_ratio); }
+    size_t pixel_count() const { return size_t(image_width) * image_height(); }
+};
+
+inline void print_usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--config FILE] [--KEY VALUE | --KEY=VALUE]...\n"
+              << "Config files hold one KEY = VALUE per line, # starts a comment. Later settings override earlier ones.\n"
+              << "Keys:\n"
+              << "  scene (default | random | glass | enclosed), scene_size,\n"
+              << "  width, aspect (e.g. 16:9 or 1.5), spp, max_depth, rr_depth, tile_size, threads, workers, seed,\n"
+              << "  accel (bvh | linear_bvh | bvh4), bvh_split (median | sah), packet_size (1 | 4 | 8 | 16),\n"
+              << "  adaptive (0 | 1), adaptive_min_samples, adaptive_max_samples, adaptive_pass_samples, adaptive_max_error,\n"
+              << "  progressive (0 | 1), snapshot_interval (seconds),\n"
+              << "  checkpoint (file, off if empty), checkpoint_interval (seconds), resume (0 | 1),\n"
+              << "  progress (0 | 1), output (PNG), hdr_output (PFM of the linear radiance, off if empty),\n"
+              << "  heatmap (PNG of the render time of each pixel, off if empty),\n"
+              << "  trace (Chrome trace JSON of build, tile and encode times, off if empty),\n"
+              << "  tonemap (PFM to convert to output instead of rendering)\n";
+}
+
+inline bool parse_number(const std::string& text, double& out)
+{
+    char* end = nullptr;
+    out = std::strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+// non-negative integer that fits in T
+template <typename T>
+inline bool parse_count(const std::string& text, T& out)
+{
+    if (text.empty() || text[0] == '-')
+        return false;
+
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || value > static_cast<unsigned long long>(std::numeric_limits<T>::max()))
+        return false;
+    out = static_cast<T>(value);
+    return true;
+}
+
+// Sets one setting from its text form. Returns false (after printing why) for unknown keys and bad values.
+inline bool apply_setting(render_settings& settings, const std::string& key, const std::string& value)
+{
+    bool ok = true;
+
+    if (key == "scene")
+    {
+        ok = value == "default" || value == "random" || value == "glass" || value == "enclosed";
+        settings.scene = value;
+    }
+    else if (key == "scene_size")
+        ok = parse_count(value, settings.scene_size);
+    else if (key == "width")
+        ok = parse_count(value, settings.image_width) && settings.image_width > 1;
+    else if (key == "aspect")
+    {
+        size_t colon = value.find(':');
+        double w = 0, h = 1;
+        ok = colon == std::string::npos ? parse_number(value, w)
+                                        : parse_number(value.substr(0, colon), w) && parse_number(value.substr(colon + 1), h);
+        ok = ok && w > 0 && h > 0;
+        if (ok)
+            settings.aspect_ratio = w / h;
+    }
+    else if (key == "spp")
+        ok = parse_count(value, settings.samples_per_pixel) && settings.samples_per_pixel > 0;
+    else if (key == "max_depth")
+        ok = parse_count(value, settings.max_depth);
+    else if (key == "rr_depth")
+        ok = parse_count(value, settings.russian_roulette_depth);
+    else if (key == "tile_size")
+        ok = parse_count(value, settings.tile_size) && settings.tile_size > 0;
+    else if (key == "threads")
+        ok = parse_count(value, settings.threads);
+    else if (key == "workers")
+        ok = parse_count(value, settings.workers);
+    else if (key == "seed")
+        ok = parse_count(value, settings.seed);
+    else if (key == "accel")
+    {
+        if (value == "bvh")
+            settings.accel = accel_type::bvh;
+        else if (value == "linear_bvh")
+            settings.accel = accel_type::linear_bvh;
+        else if (value == "bvh4")
+            settings.accel = accel_type::bvh4;
+        else
+            ok = false;
+    }
+    else if (key == "bvh_split")
+    {
+        if (value == "median")
+            settings.bvh_split = bvh_split_method::median;
+        else if (value == "sah")
+            settings.bvh_split = bvh_split_method::sah;
+        else
+            ok = false;
+    }
+    else if (key == "packet_size")
+    {
+        ok = parse_count(value, settings.packet_size);
+        ok = ok && (settings.packet_size == 1 || settings.packet_size == 4 || settings.packet_size == 8 || settings.packet_size == 16);
+    }
+    else if (key == "adaptive")
+    {
+        ok = value == "0" || value == "1";
+        settings.adaptive = value == "1";
+    }
+    else if (key == "adaptive_min_samples")
+        ok = parse_count(value, settings.adaptive_min_samples) && settings.adaptive_min_samples >= 2;
+    else if (key == "adaptive_max_samples")
+        ok = parse_count(value, settings.adaptive_max_samples);
+    else if (key == "adaptive_pass_samples")
+        ok = parse_count(value, settings.adaptive_pass_samples) && settings.adaptive_pass_samples > 0;
+    else if (key == "adaptive_max_error")
+        ok = parse_number(value, settings.adaptive_max_error) && settings.adaptive_max_error >= 0;
+    else if (key == "progressive")
+    {
+        ok = value == "0" || value == "1";
+        settings.progressive = value == "1";
+    }
+    else if (key == "snapshot_interval")
+        ok = parse_number(value, settings.snapshot_interval) && settings.snapshot_interval >= 0;
+    else if (key == "checkpoint")
+        settings.checkpoint = value;
+    else if (key == "checkpoint_interval")
+        ok = parse_number(value, settings.checkpoint_interval) && settings.checkpoint_interval >= 0;
+    else if (key == "resume")
+    {
+        ok = value == "0" || value == "1";
+        settings.resume = value == "1";
+    }
+    else if (key == "progress")
+    {
+        ok = value == "0" || value == "1";
+        settings.progress = value == "1";
+    }
+    else if (key == "output")
+    {
+        ok = !value.empty();
+        settings.output = value;
+    }
+    else if (key == "hdr_output")
+        settings.hdr_output = value;
+    else if (key == "heatmap")
+        settings.heatmap = value;
+    else if (key == "trace")
+        settings.trace = value;
+    else if (key == "tonemap")
+        settings.tonemap_input = value;
+    else
+    {
+        std::cerr << "Unknown setting '" << key << "'\n";
+        return false;
+    }
+
+    if (!ok)
+        std::cerr << "Invalid value '" << value << "' for setting '" << key << "'\n";
+    return ok;
+}
+
+inline std::string trim(const std::string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+inline bool load_settings_file(render_settings& settings, const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Can't open config file '" << path << "'\n";
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line))
+    {
+        line_number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            std::cerr << path << ":" << line_number << ": expected KEY = VALUE\n";
+            return false;
+        }
+        if (!apply_setting(settings, trim(line.substr(0, equals)), trim(line.substr(equals + 1))))
+        {
+            std::cerr << path << ":" << line_number << ": in this line\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hash of the settings that decide what a render's pixels are, so a checkpoint is only resumed by the same
+// render. Threads, tiles, accelerator and outputs don't change any pixel and are left out.
+inline uint64_t render_settings_hash(const render_settings& settings)
+{
+    double aspect = settings.aspect_ratio;
+    double max_error = settings.adaptive_max_error;
+    uint64_t aspect_bits, max_error_bits;
+    std::memcpy(&aspect_bits, &aspect, sizeof(aspect));
+    std::memcpy(&max_error_bits, &max_error, sizeof(max_error));
+
+    uint64_t values[] = {
+        settings.image_width, aspect_bits, settings.samples_per_pixel, uint64_t(settings.max_depth),
+        uint64_t(settings.russian_roulette_depth), settings.seed, settings.progressive, settings.adaptive,
+        settings.adaptive_min_samples, settings.adaptive_max_samples, settings.adaptive_pass_samples, max_error_bits,
+    };
+
+    uint64_t h = 0;
+    for (char c : settings.scene)
+        h = hash64(h ^ uint64_t(c)) + 0x9e3779b97f4a7c15ULL;
+    h = hash64(h ^ settings.scene_size);
+    for (uint64_t v : values)
+        h = hash64(h ^ v) + 0x9e3779b97f4a7c15ULL;
+    return h;
+}
+
+// Checks what no single setting can on its own, once all of them are applied. Returns false (after printing why)
+// if the settings can't be rendered.
+inline bool check_settings(const render_settings& settings)
+{
+    // width and aspect can come in either order; pixel coordinates are divided by height - 1
+    if (settings.image_height() < 2)
+    {
+        std::cerr << "Width " << settings.image_width << " and aspect " << settings.aspect_ratio << " give an image height of "
+                  << settings.image_height() << ", at least 2 is needed\n";
+        return false;
+    }
+    return true;
+}
+
+// Applies the command line on top of the defaults already in settings. Returns false if it is malformed or
+// asks for help, in which case the caller should exit.
+inline bool parse_settings(int argc, char** argv, render_settings& settings)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+        if (arg.rfind("--", 0) != 0)
+        {
+            std::cerr << "Unexpected argument '" << arg << "'\n";
+            print_usage(argv[0]);
+            return false;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value;
+        size_t equals = key.find('=');
+        if (equals != std::string::npos)
+        {
+            value = key.substr(equals + 1);
+            key = key.substr(0, equals);
+        }
+        else if (i + 1 < argc)
+        {
+            value = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Missing value for '" << arg << "'\n";
+            return false;
+        }
+
+        bool ok = key == "config" ? load_settings_file(settings, value) : apply_setting(settings, key, value);
+        if (!ok)
+            return false;
+    }
+
+    if (!check_settings(settings))
+    {
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+#endif // RT_SETTINGS
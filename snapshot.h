@@ -0,0 +1,94 @@
+#ifndef RT_SNAPSHOT
+#define RT_SNAPSHOT
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "image.h"
+
+// Background thread that saves previews of a render in progress. The renderer hands it a copy of the
+// accumulation buffer whenever it has one (publish), and the writer tonemaps and saves the newest copy at
+// most once per interval, so slow PNG encoding never holds up rendering.
+struct snapshot_writer
+{
+    snapshot_writer(const std::string& _path, double interval_seconds)
+        : path(_path), interval(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval_seconds)))
+    {
+        next_write = clock::now();
+        thread = std::thread(&snapshot_writer::writer_loop, this);
+    }
+
+    // stops without writing whatever is still pending, the caller writes the final image itself
+    ~snapshot_writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    snapshot_writer(const snapshot_writer&) = delete;
+    snapshot_writer& operator=(const snapshot_writer&) = delete;
+
+    // replaces any snapshot that hasn't been written yet
+    void publish(const hdr_buffer& hdr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = hdr;
+            has_pending = true;
+        }
+        wake.notify_one();
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    std::string path;
+    clock::duration interval;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    hdr_buffer pending;
+    bool has_pending = false;
+    bool stopping = false;
+    clock::time_point next_write;
+
+    void writer_loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        hdr_buffer current;
+
+        while (!stopping)
+        {
+            if (!has_pending)
+            {
+                wake.wait(lock);
+                continue;
+            }
+            if (clock::now() < next_write)
+            {
+                wake.wait_until(lock, next_write);
+                continue;
+            }
+
+            std::swap(current, pending);
+            has_pending = false;
+            lock.unlock();
+
+            write_png(path, current);
+
+            lock.lock();
+            next_write = clock::now() + interval;
+        }
+    }
+};
+
+#endif // RT_SNAPSHOT
@@ -3,37 +3,26 @@
 
 #include "hittable.h"
 
-struct sphere : public hittable
-{
-    sphere() {}
-    sphere(point3 _center, double _radius, shared_ptr<material> _material) : center(_center), radius(_radius), material(_material) { }
-
-    point3 center;
-    double radius;
-
-    shared_ptr<material> material;
-
-    bool hit(const ray& ray, double t_min, double t_max, hit_record& rec) const override;
-};
-
-
-bool sphere::hit(const ray& ray, double t_min, double t_max, hit_record& rec) const 
+// Ray-sphere intersection: the nearest root of |origin + t * dir - center|^2 = radius^2 in [t_min, t_max].
+// Templated on the scalar type so precision.cpp can run it in float and in double on the same rays.
+template <typename T>
+inline bool hit_sphere(const vec3_t<T>& center, T radius, const ray_t<T>& ray, T t_min, T t_max, T& root)
 {
     // quadratic equation
-    vec3 diff = ray.origin() - center;
-    double a = ray.direction().length_squared();
-    double half_b = dot(diff, ray.direction());
-    double c = diff.length_squared() - radius * radius;
-    double discriminant = half_b*half_b - a*c;
+    vec3_t<T> diff = ray.origin() - center;
+    T a = ray.direction().length_squared();
+    T half_b = dot(diff, ray.direction());
+    T c = diff.length_squared() - radius * radius;
+    T discriminant = half_b*half_b - a*c;
     // discriminant: positive = two real solutions, zero = one real solution, negative = no real solutions 
     if (discriminant < 0)
     {
         return false;
     }
 
-    double sqrtDisc = sqrt(discriminant);
+    T sqrtDisc = sqrt(discriminant);
 
-    double root = (-half_b - sqrtDisc) / a;
+    root = (-half_b - sqrtDisc) / a;
 
     // find nearest root that lies in the acceptable range
     if (root < t_min || t_max < root) {
@@ -41,17 +30,50 @@ bool sphere::hit(const ray& ray, double t_min, double t_max, hit_record& rec) co
         if (root < t_min || t_max < root)
             return false;
     }
+    return true;
+}
+
+struct sphere : public hittable
+{
+    sphere() {}
+    sphere(point3 _center, real _radius, const material* _mat) : center(_center), radius(_radius), mat(_mat) { }
+
+    point3 center;
+    real radius;
+
+    const material* mat; // owned by the scene
+
+    bool hit(const ray& ray, real t_min, real t_max, hit_record& rec) const override;
+    bool bounding_box(aabb& output_box) const override;
+};
+
+
+bool sphere::hit(const ray& ray, real t_min, real t_max, hit_record& rec) const 
+{
+    RT_STAT_INC(primitive_tests);
+
+    real root;
+    if (!hit_sphere(center, radius, ray, t_min, t_max, root))
+        return false;
 
     rec.time = root;
     rec.point = ray.at(rec.time);
     vec3 outward_normal = (rec.point - center) / radius;
 
     rec.set_face_normal(ray, outward_normal);
-    rec.material = material;
+    rec.mat = mat;
 
     return true;
 }
 
+bool sphere::bounding_box(aabb& output_box) const
+{
+    // fabs since the inner surface of a hollow glass sphere is modelled with a negative radius
+    vec3 extent(fabs(radius), fabs(radius), fabs(radius));
+    output_box = aabb(center - extent, center + extent);
+    return true;
+}
+
 
 
 #endif // RT_SPHERE
\ No newline at end of file
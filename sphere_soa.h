@@ -0,0 +1,394 @@
+#ifndef RT_SPHERE_SOA
+#define RT_SPHERE_SOA
+
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include "sphere.h"
+
+using std::vector;
+
+// The kernel runs on four spheres at once: one AVX register of doubles, or in a float build (see real) one
+// SSE register of floats, which every x86-64 CPU has.
+#if defined(RT_FLOAT) && (defined(__SSE2__) || defined(_M_X64))
+#define RT_SPHERE_SOA_SSE
+#include <immintrin.h>
+#elif !defined(RT_FLOAT) && defined(__AVX2__)
+#define RT_SPHERE_SOA_AVX
+#include <immintrin.h>
+#endif
+
+// spheres intersected together by one pass of the kernel
+const uint32_t SPHERE_SOA_WIDTH = 4;
+
+#ifdef RT_SPHERE_SOA_AVX
+// c + a * b and c - a * b, fused where the CPU has FMA
+inline __m256d sphere_soa_madd(__m256d a, __m256d b, __m256d c)
+{
+#ifdef __FMA__
+    return _mm256_fmadd_pd(a, b, c);
+#else
+    return _mm256_add_pd(c, _mm256_mul_pd(a, b));
+#endif
+}
+
+inline __m256d sphere_soa_nmadd(__m256d a, __m256d b, __m256d c)
+{
+#ifdef __FMA__
+    return _mm256_fnmadd_pd(a, b, c);
+#else
+    return _mm256_sub_pd(c, _mm256_mul_pd(a, b));
+#endif
+}
+
+// The ray-sphere math of both AVX kernels, for four (ray, sphere) pairs with diff = origin - center and a = the
+// squared length of the direction. Every multiply-add is spelled out, so the compiler has none left to fuse on
+// its own however it inlines these, and hit() and hit_packet() give a ray bit-identical results.
+inline __m256d sphere_soa_half_b(__m256d diff_x, __m256d diff_y, __m256d diff_z, __m256d dx, __m256d dy, __m256d dz)
+{
+    return sphere_soa_madd(diff_z, dz, sphere_soa_madd(diff_y, dy, _mm256_mul_pd(diff_x, dx)));
+}
+
+inline __m256d sphere_soa_discriminant(__m256d diff_x, __m256d diff_y, __m256d diff_z, __m256d half_b, __m256d a, __m256d rad)
+{
+    __m256d diff_len2 = sphere_soa_madd(diff_z, diff_z, sphere_soa_madd(diff_y, diff_y, _mm256_mul_pd(diff_x, diff_x)));
+    __m256d c = sphere_soa_nmadd(rad, rad, diff_len2);
+    return sphere_soa_nmadd(a, c, _mm256_mul_pd(half_b, half_b));
+}
+
+// near and far roots, meaningless where the discriminant is negative
+inline void sphere_soa_roots(__m256d half_b, __m256d discriminant, __m256d a, __m256d& near_root, __m256d& far_root)
+{
+    __m256d sqrt_disc = _mm256_sqrt_pd(_mm256_max_pd(discriminant, _mm256_setzero_pd()));
+    __m256d neg_half_b = _mm256_sub_pd(_mm256_setzero_pd(), half_b);
+    near_root = _mm256_div_pd(_mm256_sub_pd(neg_half_b, sqrt_disc), a);
+    far_root = _mm256_div_pd(_mm256_add_pd(neg_half_b, sqrt_disc), a);
+}
+#endif
+
+// std::allocator with a stronger alignment, so SIMD loads from the start of an array never split a cache line
+template <typename T, size_t alignment>
+struct aligned_allocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = aligned_allocator<U, alignment>; };
+
+    aligned_allocator() {}
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, alignment>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignment))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(alignment)); }
+
+    bool operator==(const aligned_allocator&) const { return true; }
+    bool operator!=(const aligned_allocator&) const { return false; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T, 32>>;
+
+// Spheres stored structure-of-arrays: each field in its own 32-byte aligned array, so the same field of
+// SPHERE_SOA_WIDTH consecutive spheres loads into one register and they are intersected with one instruction
+// sequence. Materials are kept once in a table and referenced by index.
+// Implements the leaf storage interface of linear_bvh / bvh4 (see primitive_array), e.g. bvh4<sphere, sphere_soa>.
+struct sphere_soa
+{
+    aligned_vector<real> center_x;
+    aligned_vector<real> center_y;
+    aligned_vector<real> center_z;
+    aligned_vector<real> radius;
+    vector<uint32_t> material_id;
+
+    vector<const material*> materials; // owned by the scene
+    std::unordered_map<const material*, uint32_t> material_index;
+
+    size_t size() const { return radius.size(); }
+
+    void reserve(size_t count)
+    {
+        center_x.reserve(count);
+        center_y.reserve(count);
+        center_z.reserve(count);
+        radius.reserve(count);
+        material_id.reserve(count);
+    }
+
+    void push_back(const sphere& s)
+    {
+        center_x.push_back(s.center.x());
+        center_y.push_back(s.center.y());
+        center_z.push_back(s.center.z());
+        radius.push_back(s.radius);
+        material_id.push_back(add_material(s.mat));
+    }
+
+    void append(const sphere_soa& other)
+    {
+        center_x.insert(center_x.end(), other.center_x.begin(), other.center_x.end());
+        center_y.insert(center_y.end(), other.center_y.begin(), other.center_y.end());
+        center_z.insert(center_z.end(), other.center_z.begin(), other.center_z.end());
+        radius.insert(radius.end(), other.radius.begin(), other.radius.end());
+
+        // other's material ids index its own table
+        vector<uint32_t> remap(other.materials.size());
+        for (size_t m = 0; m < other.materials.size(); m++)
+            remap[m] = add_material(other.materials[m]);
+        for (uint32_t id : other.material_id)
+            material_id.push_back(remap[id]);
+    }
+
+    // Intersects spheres [first, first + count), keeping the nearest hit and narrowing t_max to it.
+    // Same math as sphere::hit, evaluated for SPHERE_SOA_WIDTH spheres at a time.
+    bool hit(uint32_t first, uint32_t count, const ray& r, real t_min, real& t_max, hit_record& rec) const;
+    // Same for each ray of the packet in the bit mask rays. With AVX the kernel is turned around: it runs on
+    // four rays at once, one sphere at a time, which needs no horizontal step to find each ray's nearest hit.
+    void hit_packet(uint32_t first, uint32_t count, ray_packet& packet, uint32_t rays) const;
+
+private:
+    uint32_t add_material(const material* mat)
+    {
+        auto found = material_index.find(mat);
+        if (found != material_index.end())
+            return found->second;
+
+        uint32_t id = static_cast<uint32_t>(materials.size());
+        materials.push_back(mat);
+        material_index[mat] = id;
+        return id;
+    }
+};
+
+bool sphere_soa::hit(uint32_t first, uint32_t count, const ray& r, real t_min, real& t_max, hit_record& rec) const
+{
+    RT_STAT_ADD(primitive_tests, count);
+
+    point3 orig = r.origin();
+    vec3 dir = r.direction();
+    real a = dir.length_squared();
+
+    int64_t nearest = -1;
+    uint32_t end = first + count;
+
+    for (uint32_t base = first; base < end; base += SPHERE_SOA_WIDTH)
+    {
+        uint32_t lanes = end - base < SPHERE_SOA_WIDTH ? end - base : SPHERE_SOA_WIDTH;
+        alignas(16) real root[SPHERE_SOA_WIDTH];
+
+#ifdef RT_SPHERE_SOA_AVX
+        // masked loads, lanes past the end of the range read nothing and are discarded below
+        __m256i load_mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(lanes), _mm256_set_epi64x(3, 2, 1, 0));
+        __m256d cx = _mm256_maskload_pd(&center_x[base], load_mask);
+        __m256d cy = _mm256_maskload_pd(&center_y[base], load_mask);
+        __m256d cz = _mm256_maskload_pd(&center_z[base], load_mask);
+        __m256d rad = _mm256_maskload_pd(&radius[base], load_mask);
+
+        __m256d dx = _mm256_set1_pd(dir.x());
+        __m256d dy = _mm256_set1_pd(dir.y());
+        __m256d dz = _mm256_set1_pd(dir.z());
+        __m256d a4 = _mm256_set1_pd(a);
+
+        __m256d diff_x = _mm256_sub_pd(_mm256_set1_pd(orig.x()), cx);
+        __m256d diff_y = _mm256_sub_pd(_mm256_set1_pd(orig.y()), cy);
+        __m256d diff_z = _mm256_sub_pd(_mm256_set1_pd(orig.z()), cz);
+
+        __m256d half_b = sphere_soa_half_b(diff_x, diff_y, diff_z, dx, dy, dz);
+        __m256d discriminant = sphere_soa_discriminant(diff_x, diff_y, diff_z, half_b, a4, rad);
+        __m256d near_root, far_root;
+        sphere_soa_roots(half_b, discriminant, a4, near_root, far_root);
+
+        __m256d t_min4 = _mm256_set1_pd(t_min);
+        __m256d t_max4 = _mm256_set1_pd(t_max);
+        __m256d near_ok = _mm256_and_pd(_mm256_cmp_pd(near_root, t_min4, _CMP_GE_OQ), _mm256_cmp_pd(near_root, t_max4, _CMP_LE_OQ));
+        __m256d far_ok = _mm256_and_pd(_mm256_cmp_pd(far_root, t_min4, _CMP_GE_OQ), _mm256_cmp_pd(far_root, t_max4, _CMP_LE_OQ));
+
+        // nearest root in range, or infinity for misses and unused lanes
+        __m256d t = _mm256_blendv_pd(_mm256_set1_pd(INF), far_root, far_ok);
+        t = _mm256_blendv_pd(t, near_root, near_ok);
+        __m256d valid = _mm256_and_pd(_mm256_cmp_pd(discriminant, _mm256_setzero_pd(), _CMP_GE_OQ), _mm256_castsi256_pd(load_mask));
+        t = _mm256_blendv_pd(_mm256_set1_pd(INF), t, valid);
+        _mm256_storeu_pd(root, t);
+#elif defined(RT_SPHERE_SOA_SSE)
+        // SSE has no masked loads: a short last group is copied out, with zeros in the unused lanes
+        alignas(16) float partial[4][SPHERE_SOA_WIDTH] = {};
+        const float* fields[4] = { &center_x[base], &center_y[base], &center_z[base], &radius[base] };
+        if (lanes < SPHERE_SOA_WIDTH)
+        {
+            for (int f = 0; f < 4; f++)
+            {
+                for (uint32_t lane = 0; lane < lanes; lane++)
+                    partial[f][lane] = fields[f][lane];
+                fields[f] = partial[f];
+            }
+        }
+        __m128 cx = _mm_loadu_ps(fields[0]);
+        __m128 cy = _mm_loadu_ps(fields[1]);
+        __m128 cz = _mm_loadu_ps(fields[2]);
+        __m128 rad = _mm_loadu_ps(fields[3]);
+
+        __m128 diff_x = _mm_sub_ps(_mm_set1_ps(orig.x()), cx);
+        __m128 diff_y = _mm_sub_ps(_mm_set1_ps(orig.y()), cy);
+        __m128 diff_z = _mm_sub_ps(_mm_set1_ps(orig.z()), cz);
+        __m128 a4 = _mm_set1_ps(a);
+
+        __m128 half_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(diff_x, _mm_set1_ps(dir.x())), _mm_mul_ps(diff_y, _mm_set1_ps(dir.y()))),
+                                   _mm_mul_ps(diff_z, _mm_set1_ps(dir.z())));
+        __m128 diff_len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(diff_x, diff_x), _mm_mul_ps(diff_y, diff_y)), _mm_mul_ps(diff_z, diff_z));
+        __m128 c = _mm_sub_ps(diff_len2, _mm_mul_ps(rad, rad));
+        __m128 discriminant = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(a4, c));
+
+        __m128 sqrt_disc = _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps()));
+        __m128 neg_half_b = _mm_sub_ps(_mm_setzero_ps(), half_b);
+        __m128 near_root = _mm_div_ps(_mm_sub_ps(neg_half_b, sqrt_disc), a4);
+        __m128 far_root = _mm_div_ps(_mm_add_ps(neg_half_b, sqrt_disc), a4);
+
+        __m128 t_min4 = _mm_set1_ps(t_min);
+        __m128 t_max4 = _mm_set1_ps(t_max);
+        __m128 near_ok = _mm_and_ps(_mm_cmpge_ps(near_root, t_min4), _mm_cmple_ps(near_root, t_max4));
+        __m128 far_ok = _mm_and_ps(_mm_cmpge_ps(far_root, t_min4), _mm_cmple_ps(far_root, t_max4));
+        __m128 lane_ok = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(lanes), _mm_set_epi32(3, 2, 1, 0)));
+        __m128 valid = _mm_and_ps(_mm_cmpge_ps(discriminant, _mm_setzero_ps()), lane_ok);
+
+        // nearest root in range, or infinity for misses and unused lanes; SSE2 selects with and/andnot/or
+        __m128 inf4 = _mm_set1_ps(INF);
+        __m128 t = _mm_or_ps(_mm_and_ps(far_ok, far_root), _mm_andnot_ps(far_ok, inf4));
+        t = _mm_or_ps(_mm_and_ps(near_ok, near_root), _mm_andnot_ps(near_ok, t));
+        t = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, inf4));
+        _mm_store_ps(root, t);
+#else
+        for (uint32_t lane = 0; lane < SPHERE_SOA_WIDTH; lane++)
+        {
+            root[lane] = INF;
+            if (lane >= lanes)
+                continue;
+
+            uint32_t i = base + lane;
+            vec3 diff(orig.x() - center_x[i], orig.y() - center_y[i], orig.z() - center_z[i]);
+            real half_b = dot(diff, dir);
+            real c = diff.length_squared() - radius[i] * radius[i];
+            real discriminant = half_b * half_b - a * c;
+            if (discriminant < 0)
+                continue;
+
+            real sqrt_disc = sqrt(discriminant);
+            real near_root = (-half_b - sqrt_disc) / a;
+            real far_root = (-half_b + sqrt_disc) / a;
+            if (near_root >= t_min && near_root <= t_max)
+                root[lane] = near_root;
+            else if (far_root >= t_min && far_root <= t_max)
+                root[lane] = far_root;
+        }
+#endif
+
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+            if (root[lane] != INF && root[lane] <= t_max)
+            {
+                t_max = root[lane];
+                nearest = base + lane;
+            }
+        }
+    }
+
+    if (nearest < 0)
+        return false;
+
+    point3 center(center_x[nearest], center_y[nearest], center_z[nearest]);
+    rec.time = t_max;
+    rec.point = r.at(rec.time);
+    vec3 outward_normal = (rec.point - center) / radius[nearest];
+    rec.set_face_normal(r, outward_normal);
+    rec.mat = materials[material_id[nearest]];
+
+    return true;
+}
+
+void sphere_soa::hit_packet(uint32_t first, uint32_t count, ray_packet& packet, uint32_t rays) const
+{
+#ifdef RT_SPHERE_SOA_AVX
+    __m256d t_min4 = _mm256_set1_pd(packet.t_min);
+
+    for (uint32_t group = 0; group < packet.size; group += 4)
+    {
+        uint32_t group_rays = (rays >> group) & 0xf;
+        if (!group_rays)
+            continue;
+        RT_STAT_ADD(primitive_tests, count * ((group_rays & 1) + (group_rays >> 1 & 1) + (group_rays >> 2 & 1) + (group_rays >> 3)));
+
+        __m256d ray_ok = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+            _mm256_and_si256(_mm256_set1_epi64x(group_rays), _mm256_set_epi64x(8, 4, 2, 1)), _mm256_set_epi64x(8, 4, 2, 1)));
+        __m256d ox = _mm256_load_pd(&packet.org[0][group]);
+        __m256d oy = _mm256_load_pd(&packet.org[1][group]);
+        __m256d oz = _mm256_load_pd(&packet.org[2][group]);
+        __m256d dx = _mm256_load_pd(&packet.dir[0][group]);
+        __m256d dy = _mm256_load_pd(&packet.dir[1][group]);
+        __m256d dz = _mm256_load_pd(&packet.dir[2][group]);
+        __m256d a4 = _mm256_load_pd(&packet.dir_length_squared[group]);
+        __m256d t_max4 = _mm256_load_pd(&packet.t_max[group]);
+        __m256d nearest = _mm256_set1_pd(-1); // sphere index of each ray's nearest hit, exact in a double
+
+        // the same math as hit(), so a ray gets the same hit either way
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            __m256d diff_x = _mm256_sub_pd(ox, _mm256_set1_pd(center_x[i]));
+            __m256d diff_y = _mm256_sub_pd(oy, _mm256_set1_pd(center_y[i]));
+            __m256d diff_z = _mm256_sub_pd(oz, _mm256_set1_pd(center_z[i]));
+            __m256d rad = _mm256_set1_pd(radius[i]);
+
+            __m256d half_b = sphere_soa_half_b(diff_x, diff_y, diff_z, dx, dy, dz);
+            __m256d discriminant = sphere_soa_discriminant(diff_x, diff_y, diff_z, half_b, a4, rad);
+            // neighboring rays mostly all hit or all miss a sphere; the square root and divisions are skipped
+            // when they all miss
+            __m256d reaches = _mm256_and_pd(_mm256_cmp_pd(discriminant, _mm256_setzero_pd(), _CMP_GE_OQ), ray_ok);
+            if (_mm256_testz_pd(reaches, reaches))
+                continue;
+
+            __m256d near_root, far_root;
+            sphere_soa_roots(half_b, discriminant, a4, near_root, far_root);
+
+            __m256d near_ok = _mm256_and_pd(_mm256_cmp_pd(near_root, t_min4, _CMP_GE_OQ), _mm256_cmp_pd(near_root, t_max4, _CMP_LE_OQ));
+            __m256d far_ok = _mm256_and_pd(_mm256_cmp_pd(far_root, t_min4, _CMP_GE_OQ), _mm256_cmp_pd(far_root, t_max4, _CMP_LE_OQ));
+
+            // t_max only shrinks, so a root in range is always the ray's nearest hit so far
+            __m256d t = _mm256_blendv_pd(far_root, near_root, near_ok);
+            __m256d closer = _mm256_and_pd(_mm256_or_pd(near_ok, far_ok), reaches);
+            t_max4 = _mm256_blendv_pd(t_max4, t, closer);
+            nearest = _mm256_blendv_pd(nearest, _mm256_set1_pd(double(i)), closer);
+        }
+
+        alignas(32) double nearest_lane[4];
+        _mm256_store_pd(&packet.t_max[group], t_max4);
+        _mm256_store_pd(nearest_lane, nearest);
+
+        for (uint32_t lane = 0; lane < 4; lane++)
+        {
+            if (nearest_lane[lane] < 0)
+                continue;
+
+            uint32_t n = static_cast<uint32_t>(nearest_lane[lane]);
+            uint32_t i = group + lane;
+            const ray& r = packet.rays[i];
+            hit_record& rec = packet.rec[i];
+            point3 center(center_x[n], center_y[n], center_z[n]);
+            rec.time = packet.t_max[i];
+            rec.point = r.at(rec.time);
+            vec3 outward_normal = (rec.point - center) / radius[n];
+            rec.set_face_normal(r, outward_normal);
+            rec.mat = materials[material_id[n]];
+            packet.hit_mask |= 1u << i;
+        }
+    }
+#else
+    // the float kernel has one ray's worth of work per sphere group already; one ray at a time
+    for (uint32_t i = 0; i < packet.size; i++)
+    {
+        if ((rays & (1u << i)) && hit(first, count, packet.rays[i], packet.t_min, packet.t_max[i], packet.rec[i]))
+            packet.hit_mask |= 1u << i;
+    }
+#endif
+}
+
+#endif // RT_SPHERE_SOA
@@ -0,0 +1,149 @@
+#ifndef RT_RENDER_STATS
+#define RT_RENDER_STATS
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Ray statistics. Built with -DRT_STATS, every thread counts the rays it traces, the BVH nodes and primitives
+// it tests and how paths end, in counters of its own so counting needs no synchronization. The counters are
+// only summed for the report at the end of the render. Without RT_STATS the RT_STAT macros expand to nothing.
+
+// material types whose scatter() calls are counted separately
+enum stat_material
+{
+    STAT_LAMBERTIAN,
+    STAT_METAL,
+    STAT_DIELECTRIC,
+    STAT_MATERIAL_COUNT
+};
+
+// path length histogram buckets: paths of 0, 1, ... segments, the last one counts everything longer
+const int STATS_PATH_BUCKETS = 16;
+
+struct render_stats
+{
+    uint64_t primary_rays = 0;
+    uint64_t bounce_rays = 0;
+    uint64_t nodes_visited = 0;   // BVH nodes whose bounds were tested
+    uint64_t primitive_tests = 0; // ray-primitive intersection tests
+    uint64_t scatters[STAT_MATERIAL_COUNT] = {};
+    uint64_t path_length[STATS_PATH_BUCKETS] = {}; // segments traced per camera path
+
+    void merge(const render_stats& other)
+    {
+        primary_rays += other.primary_rays;
+        bounce_rays += other.bounce_rays;
+        nodes_visited += other.nodes_visited;
+        primitive_tests += other.primitive_tests;
+        for (int m = 0; m < STAT_MATERIAL_COUNT; m++)
+            scatters[m] += other.scatters[m];
+        for (int b = 0; b < STATS_PATH_BUCKETS; b++)
+            path_length[b] += other.path_length[b];
+    }
+};
+
+#ifdef RT_STATS
+
+// Every thread's counters, kept alive here past the end of the thread so threads that are gone still count.
+struct stats_registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<render_stats>> threads;
+
+    static stats_registry& get()
+    {
+        static stats_registry registry;
+        return registry;
+    }
+
+    render_stats total()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        render_stats sum;
+        for (const auto& s : threads)
+            sum.merge(*s);
+        return sum;
+    }
+};
+
+inline render_stats* register_thread_stats()
+{
+    auto s = std::make_shared<render_stats>();
+    stats_registry& registry = stats_registry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.push_back(s);
+    return s.get();
+}
+
+// This thread's counters, registered the first time it counts something. The pointer is constant-initialized
+// so reading it is a plain thread-local load, with no per-call initialization check by the compiler.
+inline render_stats& thread_stats()
+{
+    static thread_local render_stats* stats = nullptr;
+    if (!stats)
+        stats = register_thread_stats();
+    return *stats;
+}
+
+#define RT_STAT_ADD(counter, n) (thread_stats().counter += (n))
+#else
+#define RT_STAT_ADD(counter, n) ((void)0)
+#endif
+
+#define RT_STAT_INC(counter) RT_STAT_ADD(counter, 1)
+
+// Wall and CPU time of a stretch of the program. CPU time is for the whole process, so with all threads busy
+// it should be close to wall time times the thread count.
+struct render_timer
+{
+    std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+    std::clock_t cpu_start = std::clock();
+
+    double wall_seconds() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count(); }
+    double cpu_seconds() const { return double(std::clock() - cpu_start) / CLOCKS_PER_SEC; }
+};
+
+inline void print_render_report(const render_timer& timer, unsigned threads)
+{
+    double wall = timer.wall_seconds();
+    double cpu = timer.cpu_seconds();
+    std::cerr << "Render time: " << wall << " s wall, " << cpu << " s CPU (" << (wall > 0 ? cpu / wall : 0.0)
+              << " of " << threads << " threads busy)\n";
+
+#ifdef RT_STATS
+    render_stats s = stats_registry::get().total();
+    uint64_t rays = s.primary_rays + s.bounce_rays;
+    std::cerr << "Rays: " << s.primary_rays << " primary, " << s.bounce_rays << " bounce, "
+              << (wall > 0 ? rays / wall / 1e6 : 0.0) << " Mrays/s\n";
+    if (rays > 0)
+        std::cerr << "Per ray: " << double(s.nodes_visited) / rays << " BVH nodes, " << double(s.primitive_tests) / rays
+                  << " primitive tests\n";
+
+    const char* material_names[STAT_MATERIAL_COUNT] = { "lambertian", "metal", "dielectric" };
+    std::cerr << "Scatters:";
+    for (int m = 0; m < STAT_MATERIAL_COUNT; m++)
+        std::cerr << " " << material_names[m] << " " << s.scatters[m];
+    std::cerr << "\n";
+
+    uint64_t paths = 0;
+    for (uint64_t n : s.path_length)
+        paths += n;
+    std::cerr << "Path length (segments):\n";
+    for (int b = 0; b < STATS_PATH_BUCKETS; b++)
+    {
+        if (s.path_length[b] == 0)
+            continue;
+        std::cerr << std::setw(4) << b << (b == STATS_PATH_BUCKETS - 1 ? "+" : " ") << std::setw(14) << s.path_length[b]
+                  << std::setw(8) << std::fixed << std::setprecision(2) << 100.0 * s.path_length[b] / paths << "%\n"
+                  << std::defaultfloat;
+    }
+#endif
+}
+
+#endif // RT_RENDER_STATS
@@ -0,0 +1,114 @@
+#ifndef RT_THREAD_POOL
+#define RT_THREAD_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that repeatedly run parallel_for jobs. The calling thread takes part
+// in every job as thread 0, so a pool of size 1 spawns no threads at all and runs serially.
+struct thread_pool
+{
+    using job_fn = std::function<void(size_t index, unsigned thread_id)>;
+
+    thread_pool(unsigned thread_count = 0)
+    {
+        if (thread_count == 0)
+            thread_count = std::thread::hardware_concurrency();
+        if (thread_count == 0)
+            thread_count = 1;
+
+        for (unsigned id = 1; id < thread_count; id++)
+            workers.emplace_back(&thread_pool::worker_loop, this, id);
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Calls job(i, thread_id) once for every i in [0, count) and returns when all calls are done.
+    // Indices are handed out dynamically, so which thread runs which index is not deterministic.
+    void parallel_for(size_t count, const job_fn& job)
+    {
+        if (count == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current_job = &job;
+            job_count = count;
+            next_index = 0;
+            busy_workers = static_cast<unsigned>(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+
+        run_indices(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return busy_workers == 0; });
+        current_job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const job_fn* current_job = nullptr;
+    size_t job_count = 0;
+    std::atomic<size_t> next_index{0};
+    unsigned busy_workers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void run_indices(unsigned thread_id)
+    {
+        for (size_t i = next_index++; i < job_count; i = next_index++)
+            (*current_job)(i, thread_id);
+    }
+
+    void worker_loop(unsigned thread_id)
+    {
+        uint64_t seen_generation = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = generation;
+            }
+
+            run_indices(thread_id);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy_workers--;
+            }
+            finished.notify_one();
+        }
+    }
+};
+
+#endif // RT_THREAD_POOL
@@ -0,0 +1,38 @@
+#ifndef RT_TILE
+#define RT_TILE
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+// rectangular block of pixels [x0, x1) x [y0, y1), in the renderer's y-up pixel coordinates
+struct tile
+{
+    uint32_t x0, y0;
+    uint32_t x1, y1;
+
+    uint32_t width() const { return x1 - x0; }
+    uint32_t height() const { return y1 - y0; }
+};
+
+// Splits the image into tile_size x tile_size tiles (edge tiles are clipped). Tiles are ordered
+// top row first to match the old scanline order, so early progress shows up at the top of the image.
+inline vector<tile> make_tiles(uint32_t image_width, uint32_t image_height, uint32_t tile_size)
+{
+    vector<tile> tiles;
+    tile_size = std::max<uint32_t>(tile_size, 1);
+
+    for (uint32_t ty = 0; ty < image_height; ty += tile_size)
+    {
+        uint32_t y1 = image_height - ty;
+        uint32_t y0 = y1 > tile_size ? y1 - tile_size : 0;
+        for (uint32_t x0 = 0; x0 < image_width; x0 += tile_size)
+            tiles.push_back({ x0, y0, std::min(x0 + tile_size, image_width), y1 });
+    }
+
+    return tiles;
+}
+
+#endif // RT_TILE
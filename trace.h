@@ -0,0 +1,151 @@
+#ifndef RT_TRACE
+#define RT_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline of a render (scene and BVH build, every tile on every thread, image encoding) written as Chrome
+// trace-event JSON, to be opened in chrome://tracing or ui.perfetto.dev. Off unless trace_enabled is set
+// before rendering starts; then each thread records its events into a ring buffer of its own, so recording
+// takes no locks and costs two clock reads per event. The buffers are only read by write_trace, once the
+// threads that fill them are idle.
+
+// events kept per thread, a power of two; once it is full the oldest events are overwritten
+const size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+struct trace_event
+{
+    const char* name; // string literal, not copied
+    int64_t start_ns; // since trace_epoch
+    int64_t end_ns;
+    int64_t arg;      // e.g. the tile index, -1 for none
+};
+
+struct trace_buffer
+{
+    uint32_t thread_id; // in order of each thread's first event
+    uint64_t recorded = 0;
+    std::vector<trace_event> events = std::vector<trace_event>(TRACE_BUFFER_EVENTS);
+
+    void add(const trace_event& e) { events[recorded++ & (TRACE_BUFFER_EVENTS - 1)] = e; }
+};
+
+inline bool trace_enabled = false;
+inline const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+inline int64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+// Every thread's buffer, kept alive here past the end of the thread.
+struct trace_registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<trace_buffer>> threads;
+
+    static trace_registry& get()
+    {
+        static trace_registry registry;
+        return registry;
+    }
+};
+
+inline trace_buffer* register_trace_buffer()
+{
+    trace_registry& registry = trace_registry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto buffer = std::make_shared<trace_buffer>();
+    buffer->thread_id = static_cast<uint32_t>(registry.threads.size());
+    registry.threads.push_back(buffer);
+    return buffer.get();
+}
+
+// This thread's buffer, allocated the first time it records something (see thread_stats).
+inline trace_buffer& thread_trace_buffer()
+{
+    static thread_local trace_buffer* buffer = nullptr;
+    if (!buffer)
+        buffer = register_trace_buffer();
+    return *buffer;
+}
+
+// Records the time from its construction to the end of its scope as one event, if tracing is on.
+struct trace_scope
+{
+    const char* name;
+    int64_t arg;
+    int64_t start_ns = -1;
+
+    explicit trace_scope(const char* _name, int64_t _arg = -1) : name(_name), arg(_arg)
+    {
+        if (trace_enabled)
+            start_ns = trace_now();
+    }
+
+    ~trace_scope()
+    {
+        if (start_ns >= 0)
+            thread_trace_buffer().add({ name, start_ns, trace_now(), arg });
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+};
+
+// Writes every recorded event as a complete ("X") event, timestamps in microseconds, one track per thread.
+// Must not run while other threads may still be recording.
+inline bool write_trace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Can't write trace '" << path << "'\n";
+        return false;
+    }
+
+    trace_registry& registry = trace_registry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    // timestamps are large numbers of microseconds, and need their nanoseconds kept
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"raytracing\"}}";
+
+    uint64_t events = 0, dropped = 0;
+    for (const auto& buffer : registry.threads)
+    {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+             << ",\"args\":{\"name\":\"thread " << buffer->thread_id << "\"}}";
+
+        uint64_t first = buffer->recorded > TRACE_BUFFER_EVENTS ? buffer->recorded - TRACE_BUFFER_EVENTS : 0;
+        dropped += first;
+        for (uint64_t i = first; i < buffer->recorded; i++, events++)
+        {
+            const trace_event& e = buffer->events[i & (TRACE_BUFFER_EVENTS - 1)];
+            file << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id
+                 << ",\"ts\":" << e.start_ns / 1000.0 << ",\"dur\":" << (e.end_ns - e.start_ns) / 1000.0;
+            if (e.arg >= 0)
+                file << ",\"args\":{\"index\":" << e.arg << "}";
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    std::cerr << "Trace: " << events << " events on " << registry.threads.size() << " threads";
+    if (dropped > 0)
+        std::cerr << ", " << dropped << " oldest dropped";
+    std::cerr << "\n";
+
+    file.close();
+    return bool(file);
+}
+
+#endif // RT_TRACE
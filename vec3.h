@@ -5,32 +5,48 @@
 #include <iostream>
 
 #include "rt.h"
+#include "vec4.h"
 
 using std::sqrt;
 
-struct vec3 
+// Three component vector of scalar type T. Geometry (points, directions, normals) uses vec3 = vec3_t<real>,
+// colors always use color = vec3_t<double> so radiance is accumulated in full precision in either build.
+// Built with -DRT_SIMD_VEC, vectors are vec4.h's padded SIMD vectors instead, with the same interface.
+#ifdef RT_SIMD_VEC
+template <typename T>
+using vec3_t = vec4_t<T>;
+#else
+template <typename T>
+struct vec3_t
 {
-    double e[3];
+    T e[3];
 
-    vec3() : e{0, 0, 0} {}
-    vec3(double x, double y, double z) : e{x, y, z} {}
+    vec3_t() : e{0, 0, 0} {}
+    vec3_t(T x, T y, T z) : e{x, y, z} {}
+    // between precisions, e.g. a float build's geometry into a color; explicit so every rounding is visible
+    template <typename U>
+    explicit vec3_t(const vec3_t<U>& v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])} {}
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    double r() const { return e[0]; }
-    double g() const { return e[1]; }
-    double b() const { return e[2]; }
+    T r() const { return e[0]; }
+    T g() const { return e[1]; }
+    T b() const { return e[2]; }
 
-    inline static vec3 random() 
+    inline static vec3_t random(rng& gen) 
     {
-        return vec3(random_double(), random_double(), random_double());
+        double x = random_double(gen);
+        double y = random_double(gen);
+        return vec3_t(x, y, random_double(gen));
     }
 
-    inline static vec3 random_range(double min, double max)
+    inline static vec3_t random_range(double min, double max, rng& gen)
     {
-        return vec3(random_double_range(min, max), random_double_range(min, max), random_double_range(min, max));
+        double x = random_double_range(min, max, gen);
+        double y = random_double_range(min, max, gen);
+        return vec3_t(x, y, random_double_range(min, max, gen));
     }
 
     bool near_zero() const {
@@ -40,94 +56,98 @@ struct vec3
     }
 
     // negate
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+    T operator[](int i) const { return e[i]; }
+    T& operator[](int i) { return e[i]; }
 
-    vec3& operator+=(const vec3 &v) 
+    vec3_t& operator+=(const vec3_t &v) 
     {
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
         return *this;
     }
-    vec3& operator*=(const double t) 
+    vec3_t& operator*=(const T t) 
     {
         e[0] *= t; 
         e[1] *= t; 
         e[2] *= t; 
         return *this;
     }
-    vec3& operator/=(const double t) { return (*this *= 1/t); }
+    vec3_t& operator/=(const T t) { return (*this *= 1/t); }
 
-    double length() const { return sqrt(length_squared()); }
-    double length_squared() const { return e[0]*e[0] + e[1]*e[1] + e[2]*e[2]; }
-};
+    T length() const { return sqrt(length_squared()); }
+    T length_squared() const { return e[0]*e[0] + e[1]*e[1] + e[2]*e[2]; }
 
-using point3 = vec3;
-using color = vec3;
+    // Defined in the class (found by argument-dependent lookup) rather than as templates, so a double scalar
+    // still converts to T: with T = float, 0.5 * v works as it does with T = double.
+    friend std::ostream& operator<<(std::ostream &out, const vec3_t &v) {
+        return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
+    }
 
-inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
+    friend vec3_t operator+(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
-}
+    friend vec3_t operator-(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
-}
+    friend vec3_t operator*(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
-}
+    friend vec3_t operator*(T t, const vec3_t &v) {
+        return vec3_t(t*v.e[0], t*v.e[1], t*v.e[2]);
+    }
 
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
-}
+    friend vec3_t operator*(const vec3_t &v, T t) {
+        return t * v;
+    }
 
-inline vec3 operator*(const vec3 &v, double t) {
-    return t * v;
-}
+    friend vec3_t operator/(vec3_t v, T t) {
+        return (1/t) * v;
+    }
 
-inline vec3 operator/(vec3 v, double t) {
-    return (1/t) * v;
-}
+    friend T dot(const vec3_t &u, const vec3_t &v) {
+        return u.e[0] * v.e[0]
+             + u.e[1] * v.e[1]
+             + u.e[2] * v.e[2];
+    }
 
-inline double dot(const vec3 &u, const vec3 &v) {
-    return u.e[0] * v.e[0]
-         + u.e[1] * v.e[1]
-         + u.e[2] * v.e[2];
-}
+    friend vec3_t cross(const vec3_t &u, const vec3_t &v) {
+        return vec3_t(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                      u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                      u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    }
 
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
-}
+    friend vec3_t unit_vector(vec3_t v) {
+        return v / v.length();
+    }
+};
+#endif
 
-inline vec3 unit_vector(vec3 v) {
-    return v / v.length();
-}
+using vec3 = vec3_t<real>;
+using point3 = vec3;
+using color = vec3_t<double>;
 
-vec3 random_in_unit_sphere()
+vec3 random_in_unit_sphere(rng& gen)
 {
     while (true) {
-        vec3 p = vec3::random_range(-1, 1);
+        vec3 p = vec3::random_range(-1, 1, gen);
         if (p.length_squared() >= 1) continue;
         return p;
     }
 }
 
 // Gets random point within unit sphere, then normalizes it to get to being on the unit sphere 
-vec3 random_unit_vector()
+vec3 random_unit_vector(rng& gen)
 {
-    return unit_vector(random_in_unit_sphere());
+    return unit_vector(random_in_unit_sphere(gen));
 }
 
-vec3 random_in_hemisphere(const vec3& normal) {
-    vec3 in_unit_sphere = random_in_unit_sphere();
+vec3 random_in_hemisphere(const vec3& normal, rng& gen) {
+    vec3 in_unit_sphere = random_in_unit_sphere(gen);
     return dot(in_unit_sphere, normal) > 0.0 ? // in same hemisphere as normal?
         in_unit_sphere :
         -in_unit_sphere;
@@ -148,11 +168,12 @@ vec3 refract(const vec3& uv, const vec3& normal, double etai_over_etat)
 }
 
 // for use with thin lens approximation from depth of field
-vec3 random_in_unit_disk()
+vec3 random_in_unit_disk(rng& gen)
 {
     while (true)
     {
-        vec3 p(random_double_range(-1, 1), random_double_range(-1, 1), 0);
+        double x = random_double_range(-1, 1, gen);
+        vec3 p(x, random_double_range(-1, 1, gen), 0);
         if (p.length_squared() >= 1) continue;
         return p;
     }
@@ -0,0 +1,197 @@
+#ifndef RT_VEC4
+#define RT_VEC4
+
+#include <cmath>
+#include <iostream>
+
+#include "rt.h"
+
+// Four lanes in one SIMD register: floats in an SSE register, which every x86-64 CPU has, and doubles in an
+// AVX register (AVX2 for the cross-lane permutes). Anything else falls back to plain scalar code.
+#if defined(__SSE2__) || defined(_M_X64)
+#define RT_VEC4_SSE
+#include <immintrin.h>
+#endif
+#if defined(__AVX2__)
+#define RT_VEC4_AVX
+#include <immintrin.h>
+#endif
+
+// The storage and arithmetic of vec4_t, specialized below for the types that have a SIMD register of four
+// lanes. Lane 3 is always 0.
+template <typename T>
+struct vec4_kernels
+{
+    struct alignas(4 * sizeof(T)) reg
+    {
+        T e[4];
+    };
+
+    static reg set(T x, T y, T z) { return { { x, y, z, 0 } }; }
+    static T lane(const reg& r, int i) { return r.e[i]; }
+
+    static reg add(const reg& u, const reg& v) { return set(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]); }
+    static reg sub(const reg& u, const reg& v) { return set(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]); }
+    static reg mul(const reg& u, const reg& v) { return set(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]); }
+    static reg scale(const reg& v, T t) { return set(t * v.e[0], t * v.e[1], t * v.e[2]); }
+    static T dot(const reg& u, const reg& v) { return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2]; }
+
+    static reg cross(const reg& u, const reg& v)
+    {
+        return set(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                   u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                   u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    }
+};
+
+#ifdef RT_VEC4_SSE
+template <>
+struct vec4_kernels<float>
+{
+    using reg = __m128;
+
+    static reg set(float x, float y, float z) { return _mm_set_ps(0, z, y, x); }
+    static float lane(reg r, int i)
+    {
+        // constant i (every x(), y(), z()) compiles to a shuffle, not a trip through memory
+        alignas(16) float e[4];
+        _mm_store_ps(e, r);
+        return e[i];
+    }
+
+    static reg add(reg u, reg v) { return _mm_add_ps(u, v); }
+    static reg sub(reg u, reg v) { return _mm_sub_ps(u, v); }
+    static reg mul(reg u, reg v) { return _mm_mul_ps(u, v); }
+    static reg scale(reg v, float t) { return _mm_mul_ps(v, _mm_set1_ps(t)); }
+
+    static float dot(reg u, reg v)
+    {
+        // horizontal sum: (x + z, y + w), then their sum; w is 0
+        __m128 p = _mm_mul_ps(u, v);
+        __m128 s = _mm_add_ps(p, _mm_movehl_ps(p, p));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1))));
+    }
+
+    static reg cross(reg u, reg v)
+    {
+        // u.yzx * v.zxy - u.zxy * v.yzx, written as (u * v.yzx - u.yzx * v).yzx to need three shuffles
+        __m128 u_yzx = _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 v_yzx = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 c = _mm_sub_ps(_mm_mul_ps(u, v_yzx), _mm_mul_ps(u_yzx, v));
+        return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+};
+#endif
+
+#ifdef RT_VEC4_AVX
+template <>
+struct vec4_kernels<double>
+{
+    using reg = __m256d;
+
+    static reg set(double x, double y, double z) { return _mm256_set_pd(0, z, y, x); }
+    static double lane(reg r, int i)
+    {
+        alignas(32) double e[4];
+        _mm256_store_pd(e, r);
+        return e[i];
+    }
+
+    static reg add(reg u, reg v) { return _mm256_add_pd(u, v); }
+    static reg sub(reg u, reg v) { return _mm256_sub_pd(u, v); }
+    static reg mul(reg u, reg v) { return _mm256_mul_pd(u, v); }
+    static reg scale(reg v, double t) { return _mm256_mul_pd(v, _mm256_set1_pd(t)); }
+
+    static double dot(reg u, reg v)
+    {
+        // horizontal sum: the upper half onto the lower, (x + z, y + w), then those two; w is 0
+        __m256d p = _mm256_mul_pd(u, v);
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(p), _mm256_extractf128_pd(p, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+    static reg cross(reg u, reg v)
+    {
+        // same as the float version, permuting across the two halves of the register
+        __m256d u_yzx = _mm256_permute4x64_pd(u, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256d v_yzx = _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256d c = _mm256_sub_pd(_mm256_mul_pd(u, v_yzx), _mm256_mul_pd(u_yzx, v));
+        return _mm256_permute4x64_pd(c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+};
+#endif
+
+// A 3D vector padded to four lanes and held in a SIMD register type, so loading or storing a whole vector is
+// one aligned instruction and every operation is a few vector instructions. It is built with a register-wide
+// set rather than lane by lane, which would make the next vector load wait for three scalar stores. Same
+// interface as vec3_t except that lanes are read-only; it replaces vec3_t in builds with -DRT_SIMD_VEC.
+template <typename T>
+struct vec4_t
+{
+    using kernels = vec4_kernels<T>;
+    using reg = typename kernels::reg;
+
+    reg v;
+
+    vec4_t() : v(kernels::set(0, 0, 0)) {}
+    vec4_t(T x, T y, T z) : v(kernels::set(x, y, z)) {}
+    explicit vec4_t(reg r) : v(r) {}
+    template <typename U>
+    explicit vec4_t(const vec4_t<U>& u) : v(kernels::set(T(u.x()), T(u.y()), T(u.z()))) {}
+
+    T x() const { return kernels::lane(v, 0); }
+    T y() const { return kernels::lane(v, 1); }
+    T z() const { return kernels::lane(v, 2); }
+
+    T r() const { return x(); }
+    T g() const { return y(); }
+    T b() const { return z(); }
+
+    inline static vec4_t random(rng& gen)
+    {
+        double x = random_double(gen);
+        double y = random_double(gen);
+        return vec4_t(x, y, random_double(gen));
+    }
+
+    inline static vec4_t random_range(double min, double max, rng& gen)
+    {
+        double x = random_double_range(min, max, gen);
+        double y = random_double_range(min, max, gen);
+        return vec4_t(x, y, random_double_range(min, max, gen));
+    }
+
+    bool near_zero() const {
+        const auto epsilon = 1e-8;
+        return (fabs(x()) < epsilon) && (fabs(y()) < epsilon) && (fabs(z()) < epsilon);
+    }
+
+    vec4_t operator-() const { return vec4_t(kernels::sub(kernels::set(0, 0, 0), v)); }
+    T operator[](int i) const { return kernels::lane(v, i); }
+
+    vec4_t& operator+=(const vec4_t &u) { v = kernels::add(v, u.v); return *this; }
+    vec4_t& operator*=(const T t) { v = kernels::scale(v, t); return *this; }
+    vec4_t& operator/=(const T t) { return (*this *= 1/t); }
+
+    T length() const { return sqrt(length_squared()); }
+    T length_squared() const { return kernels::dot(v, v); }
+
+    friend std::ostream& operator<<(std::ostream &out, const vec4_t &u) {
+        return out << u.x() << ' ' << u.y() << ' ' << u.z();
+    }
+
+    friend vec4_t operator+(const vec4_t &u, const vec4_t &w) { return vec4_t(kernels::add(u.v, w.v)); }
+    friend vec4_t operator-(const vec4_t &u, const vec4_t &w) { return vec4_t(kernels::sub(u.v, w.v)); }
+    friend vec4_t operator*(const vec4_t &u, const vec4_t &w) { return vec4_t(kernels::mul(u.v, w.v)); }
+    friend vec4_t operator*(T t, const vec4_t &u) { return vec4_t(kernels::scale(u.v, t)); }
+    friend vec4_t operator*(const vec4_t &u, T t) { return vec4_t(kernels::scale(u.v, t)); }
+    friend vec4_t operator/(const vec4_t &u, T t) { return vec4_t(kernels::scale(u.v, 1/t)); }
+
+    friend T dot(const vec4_t &u, const vec4_t &w) { return kernels::dot(u.v, w.v); }
+    friend vec4_t cross(const vec4_t &u, const vec4_t &w) { return vec4_t(kernels::cross(u.v, w.v)); }
+    friend vec4_t unit_vector(const vec4_t &u) { return vec4_t(kernels::scale(u.v, 1/u.length())); }
+};
+
+static_assert(sizeof(vec4_t<float>) == 16 && sizeof(vec4_t<double>) == 32, "vec4_t should be exactly four lanes");
+
+#endif // RT_VEC4